@@ -7,9 +7,20 @@
 #include "stdlib.h"
 #include <time.h>
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #include <chrono>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <immintrin.h>
 using namespace std;
 using namespace chrono;
 #define ulong unsigned long 
@@ -17,23 +28,48 @@ using namespace chrono;
 
 
 int MAX_NUM_POLYS = 10000;   //Maximum number of polynomials in each step. Increase if necessary.
-int NUM_THREADS = 8;         //Number of threads. 
+int NUM_THREADS = 8;         //Number of threads. If it is 0 in the instruction file, all the CPUs 
+                             //  available to the process are used (see available_num_threads).
 int trigger_wait=1;          //Wait value of the first level simplification process. (see
 														 //  quick_simplify in the Polynomial class.)
 int trigger_random_jumps=0;  //Random_jump value of the first level simplification process.
 int weight=36;               //Hamming weight of the code
+int num_weights=1;           //Number of target weights swept in a single enumeration pass.
+int *weights=&weight;        //List of target weights. The first line of the instruction
+                             //  file may contain several weights separated by spaces.
 int num_bases=2;            //Number of base polynomials (see the paper and jupyter notebook) 
                              //  for the definition of the base polynomials. 
+const char *cache_file=NULL; //Cache file of the processed base pairs and representatives of 
+                             //  previous runs (command line option -cache). See poly_cache.h.
+int shard_index=0;           //With the command line option -shard, this process only enumerates 
+int num_shards=1;            //  the shard_index-th of num_shards consecutive slices of the base 
+const char *shard_file=NULL; //  pairs and writes its polynomial lists into shard_file. The shard 
+                             //  files are combined with the option -merge.
+const char *external_dir=NULL;//With the command line option -external, the lists that reach MAX_NUM_POLYS 
+                             //  are written into this directory instead of aborting (see the 
+                             //  EXTERNAL MEMORY MODE section below).
+int stable_rounds=100;       //simplify_poly_list stops when the number of polynomials has not 
+                             //  changed for this many rounds (command line option -stable_rounds).
+double time_limit=0;         //With the command line option -time_limit, the search stops after this 
+                             //  many seconds and the current representatives are printed as 
+                             //  provisional (see TIME LIMIT AND PROGRESS REPORTS below). 0: no limit.
+int progress_interval=60;    //Seconds between two progress reports (command line option -progress).
+                             //  0: no progress reports.
 
 class Polynomial;
 
 // Input data struction of the threads/
 struct thread_data {
-	 int weight;
 	 int  num_bases;
 	 Polynomial *Base1,*Base2;
-   Polynomial *poly_list;
-	 int num_polys;
+   Polynomial **poly_list;   //One list per target weight, poly_list[k] belongs to weights[k].
+	 int *num_polys;
+	 int cpu;                  //The CPU that the thread is pinned to.
+	 int **pair_num_polys;     //Only with the cache: the number of polynomials of weights[k] found
+	                           //  from the j-th base pair is pair_num_polys[j][k]. The polynomials
+	                           //  of each base pair are stored consecutively in poly_list[k].
+	 atomic<int> pairs_done;   //The number of base pairs of the thread that are enumerated, and the
+	 atomic<long> leaves_done; //  number of leaves of rec() visited so far. Read by the progress reports.
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -131,6 +167,51 @@ void init()
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+//                      TIME LIMIT AND PROGRESS REPORTS                       //
+////////////////////////////////////////////////////////////////////////////////
+
+//The time of the start of the program. The time limit and the progress reports count from here.
+high_resolution_clock::time_point start_time=high_resolution_clock::now();
+//Becomes true the first time some work is dropped because of the time limit, and never changes 
+//  back. It is set by the callers of time_is_up that drop the work, not by time_is_up itself, so 
+//  a run that finishes after the limit is checked (but drops nothing) is not provisional.
+atomic<bool> out_of_time(false);
+//The enumeration (rec) stops at this share of the time limit, so that the rest of the time is 
+//  left for the simplification of the polynomials found until then.
+const double ENUMERATION_SHARE=0.75;
+//The elapsed time of the last progress report.
+double last_progress=0;
+
+double elapsed_seconds()
+{
+	return duration_cast<duration<double> >(high_resolution_clock::now()-start_time).count();
+}
+
+//Returns true if the time limit is set and the given share of it has passed. Every part of the 
+//  search that may take long (rec, simplify in the Polynomial class, simplify_poly_list, 
+//  external_mix_poly_lists) checks it and stops early, leaving its polynomials valid but less 
+//  simplified, and then sets out_of_time. It is thread safe.
+bool time_is_up(double share=1)
+{
+	if(time_limit<=0)
+		return false;
+	return elapsed_seconds()>=share*time_limit;
+}
+
+//Returns true (and restarts the count) if progress_interval seconds have passed since the last 
+//  progress report. It is only called from one thread at a time.
+bool progress_due()
+{
+	if(progress_interval<=0)
+		return false;
+	double t=elapsed_seconds();
+	if(t-last_progress<progress_interval)
+		return false;
+	last_progress=t;
+	return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //                        LOADING THE POLYNOMIAL CLASS                        //
 //           PLEASE SEE THE polynomial.h LIBRARY FOR A COMPREHENSIVE          //
@@ -138,6 +219,19 @@ void init()
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "polynomial.h"
+#include "walsh.h"
+#include "local_search.h"
+#include "poly_batch.h"
+#include "poly_cache.h"
+#include "poly_set.h"
+
+//The base pairs of the instruction file.
+Polynomial *all_Base1,*all_Base2;
+//The cache of the previous runs. It is only used if the cache_file is set.
+PolyCache cache;
+//The polynomials found by all threads during the enumeration. It is not used with the cache, 
+//  since then the polynomials of each base pair are kept separately.
+PolySet shared_set;
 
 //SOME of the public objects of the Polynomial class:
 
@@ -151,8 +245,7 @@ void init()
 //  Prints the polynomial
 
 //  void clear():
-//  Sets the num_term=0, and removes all auxiliary buffers.
-//  See below for instruction
+//  Sets the num_term=0.
 
 //  ulong truth_table():
 //  Returns the truth table of the polynomial as bits of a unsigned long number.
@@ -161,18 +254,12 @@ void init()
 //  the binary digits of numbers 0 to 63 as values of variables.
 
 //  void operator=(Polynomial p):
-//  Equal operator for the polynomials. Does not copy the buffers though.
+//  Equal operator for the polynomials.
 
 //  bool operator==(Polynomial p):
 //  Check if the polynomials are equal to each other UP TO A PERMUTATION OF 
 //  VARIABLES.
 
-//  void set_buffers(Polynomial buffers[3]):
-//  Sets buffers. The polynomial class needs three more instances of itself to
-//  to operate the simplification process. It is not memory and time efficient 
-//  to generate these buffers each time, so I feed the same buffer to different
-//  polynomials. This function is used to assign these buffers.  
-
 //  void sort():
 //  This function permutes the variables such that x1 appears the most in the 
 //  terms, then x2, then x3, and so on. It also sorts the the terms in the poly 
@@ -193,6 +280,231 @@ void init()
 //  returns the polynomial with the minimum number of terms derived in any of 
 //  the steps. 
 
+////////////////////////////////////////////////////////////////////////////////
+//                         ORBITS OF THE LEAVES                               //
+//       THE AFFINE MAPS OF x3,...,x8 THAT FIX BOTH BASES MAP LEAVES OF THE   //
+//      RECURSION BELOW TO EQUIVALENT LEAVES, SO ONLY ONE LEAF OF EACH ORBIT  //
+//                               IS SIMPLIFIED.                               //
+////////////////////////////////////////////////////////////////////////////////
+
+//A leaf of rec() is the polynomial x1*Base1 + x2*Base2 + x1*x2*(q+c), where Base1 and Base2 are
+//  in the variables x3,...,x8, q is the polynomial of degree at most 2 (without constant) encoded
+//  in code, and the constant c is set by the weight (see rec). An affine map g of x3,...,x8 with 
+//  Base1(g(x))=Base1(x) and Base2(g(x))=Base2(x) maps this leaf to x1*Base1 + x2*Base2 + 
+//  x1*x2*(q(g(x))+c), which is affine equivalent to it. If this is again a leaf, the two leaves
+//  are in the same class. The orbits of the leaves under such maps are computed exactly, so 
+//  leaves in the orbit of a leaf that is already processed are skipped. Once the orbit sizes of 
+//  the processed leaves add up to the number of weight-matching leaves, the remaining leaves are
+//  all covered, and rec skips them without visiting them one by one. This is only a shortcut of 
+//  the enumeration: every weight-matching leaf that rec visits is either covered or processed, 
+//  so the counts always agree at the end of a complete enumeration and prove nothing by 
+//  themselves.
+//The points of x3,...,x8 are the numbers 0,...,63 as in truth_table, and a map is stored as the
+//  list of the images of the 64 points.
+
+//Number of random searches for maps that fix the bases. The maps found generate the group that 
+//  the orbits are computed for. A smaller group only gives smaller orbits, never wrong ones.
+const int NUM_GENERATORS=16;
+
+struct leaf_orbits {
+	int num_generators;
+	uchar generator[NUM_GENERATORS][64];
+	ulong base_table;     //The truth table of Base1+Base2.
+	int *targets;         //As in rec.
+	ulong **covered;      //Bit code of covered[k] is set if the leaf code of weights[k] is in the
+	                      //  orbit of a processed leaf.
+	long *num_matching;   //The number of weight-matching leaves of weights[k], counted beforehand.
+	long *num_covered;    //The sum of the orbit sizes of the processed leaves of weights[k].
+	long *num_orbits;     //The number of processed leaves of weights[k].
+};
+
+//The totals over all base pairs, for each target weight (see print_leaf_orbits).
+atomic<long> *total_matching,*total_orbits;
+
+//Bit number 20-i of a code stands for second_order_monomials[i]. code_bit[m] is the bit of the 
+//  monomial m (of x3,...,x8, as a 6-bit number), or -1 if m is not of degree 1 or 2.
+int code_bit[64];
+
+void init_code_bits()
+{
+	for(int m=0;m<64;m++)
+		code_bit[m]=-1;
+	for(int i=0;i<21;i++)
+		code_bit[second_order_monomials[i]]=20-i;
+}
+
+ulong code_table(int code)
+{
+	ulong table=0;
+	for(int j=0;j<21;j++)
+		if(code&(1<<j))
+			table^=second_order_table[20-j];
+	return table;
+}
+
+//The constant of the leaf with the truth table table of q (see rec) for the target weight target.
+bool leaf_constant(ulong base_table,ulong table,int target)
+{
+	return __builtin_popcountl(base_table^table)==64-target;
+}
+
+//Searches for an affine map g with table1(g(x))=table1(x) and table2(g(x))=table2(x), trying the
+//  choices in a random order. img[x] is the linear part of g on the points x<2^level, and b is the
+//  translation. Returns true and fills map if it finds one.
+bool search_stabilizer(ulong table1,ulong table2,int level,uchar img[64],int b,uchar map[64])
+{
+	if(level==6){
+		for(int x=0;x<64;x++)
+			map[x]=img[x]^b;
+		return true;
+	}
+	int half=1<<level,start=rand()%63;
+	for(int i=0;i<63;i++){
+		int a=1+(start+i)%63;
+		bool ok=true;
+		for(int x=0;x<half && ok;x++)
+			if(img[x]==a)
+				ok=false;
+		for(int x=0;x<half && ok;x++){
+			img[half+x]=img[x]^a;
+			int y=img[half+x]^b;
+			if(((table1>>y)&1)!=((table1>>(half+x))&1) || ((table2>>y)&1)!=((table2>>(half+x))&1))
+				ok=false;
+		}
+		if(ok && search_stabilizer(table1,table2,level+1,img,b,map))
+			return true;
+	}
+	return false;
+}
+
+//Fills orbits with the maps that fix Base1 and Base2, and counts the weight-matching leaves.
+void init_leaf_orbits(leaf_orbits &orbits,Polynomial &Base1,Polynomial &Base2,int *targets)
+{
+	ulong table1=Base1.truth_table(),table2=Base2.truth_table();
+	uchar img[64],map[64];
+	orbits.num_generators=0;
+	for(int i=0;i<NUM_GENERATORS;i++){
+		int start=rand()%64;
+		for(int j=0;j<64;j++){
+			int b=(start+j)%64;
+			if(((table1>>b)&1)!=(table1&1) || ((table2>>b)&1)!=(table2&1))
+				continue;
+			img[0]=0;
+			if(search_stabilizer(table1,table2,0,img,b,map))
+				break;
+		}
+		bool identity=true;
+		for(int x=0;x<64;x++)
+			if(map[x]!=x)
+				identity=false;
+		if(!identity){
+			memcpy(orbits.generator[orbits.num_generators],map,64);
+			orbits.num_generators++;
+		}
+	}
+	orbits.base_table=table1^table2;
+	orbits.targets=targets;
+	orbits.covered=new ulong*[num_weights];
+	orbits.num_matching=new long[num_weights];
+	orbits.num_covered=new long[num_weights];
+	orbits.num_orbits=new long[num_weights];
+	for(int k=0;k<num_weights;k++){
+		orbits.covered[k]=new ulong[1<<15];
+		memset(orbits.covered[k],0,sizeof(ulong)<<15);
+		orbits.num_matching[k]=orbits.num_covered[k]=orbits.num_orbits[k]=0;
+	}
+	//All codes in Gray code order, so that each step changes one monomial.
+	ulong table=orbits.base_table;
+	for(int i=0;i<(1<<21);i++){
+		if(i)
+			table^=second_order_table[20-__builtin_ctz(i)];
+		int w=__builtin_popcountl(table);
+		for(int k=0;k<num_weights;k++)
+			if(w==targets[k] || w==64-targets[k])
+				orbits.num_matching[k]++;
+	}
+}
+
+//Adds the totals of orbits to total_matching and total_orbits, and frees it.
+void free_leaf_orbits(leaf_orbits &orbits)
+{
+	for(int k=0;k<num_weights;k++){
+		total_matching[k]+=orbits.num_matching[k];
+		total_orbits[k]+=orbits.num_orbits[k];
+		delete[] orbits.covered[k];
+	}
+	delete[] orbits.covered;
+	delete[] orbits.num_matching;
+	delete[] orbits.num_covered;
+	delete[] orbits.num_orbits;
+}
+
+//Returns true if the leaf code of weights[k] is in the orbit of a processed leaf. Otherwise, 
+//  marks its orbit as covered, counts it, and returns false (the leaf has to be processed). The 
+//  image of a leaf under a map is only followed if it is again a leaf, i.e., if it matches the 
+//  weight and has the constant that rec gives it.
+bool leaf_covered(leaf_orbits &orbits,int k,int code)
+{
+	ulong *covered=orbits.covered[k];
+	if(covered[code>>6]&(((ulong)1)<<(code&63)))
+		return true;
+	int target=orbits.targets[k];
+	vector<int> queue(1,code);
+	covered[code>>6]|=((ulong)1)<<(code&63);
+	for(size_t n=0;n<queue.size();n++){
+		ulong table=code_table(queue[n]);
+		bool constant=leaf_constant(orbits.base_table,table,target);
+		for(int i=0;i<orbits.num_generators;i++){
+			//The truth table of q(g(x)), and its terms (the binary Moebius transform). Its 
+			//  constant term q(g(0)) is added to the constant of the leaf.
+			ulong image=0,terms;
+			for(int x=0;x<64;x++)
+				image|=((table>>orbits.generator[i][x])&1)<<x;
+			terms=image;
+			for(int v=0;v<6;v++)
+				terms^=(terms&~SOURCE_MASK[v])<<(1<<v);
+			if(terms&1)
+				image=~image;
+			int image_code=0;
+			for(ulong m=terms&~((ulong)1);m;m&=m-1)
+				image_code|=1<<code_bit[__builtin_ctzl(m)];
+			int w=__builtin_popcountl(orbits.base_table^image);
+			if((w!=target && w!=64-target) || 
+			   leaf_constant(orbits.base_table,image,target)!=(constant^(bool)(terms&1)))
+				continue;
+			if(!(covered[image_code>>6]&(((ulong)1)<<(image_code&63)))){
+				covered[image_code>>6]|=((ulong)1)<<(image_code&63);
+				queue.push_back(image_code);
+			}
+		}
+	}
+	orbits.num_covered[k]+=queue.size();
+	orbits.num_orbits[k]++;
+	return false;
+}
+
+//Prints the number of weight-matching leaves of all the enumerated base pairs, and the number of 
+//  them that are simplified (one per orbit).
+void print_leaf_orbits()
+{
+	for(int k=0;k<num_weights;k++){
+		cout<<"Leaves";
+		if(num_weights>1)
+			cout<<" of weight "<<weights[k];
+		cout<<": "<<total_matching[k]<<" weight-matching, "<<total_orbits[k]<<" simplified (one per orbit)"<<endl;
+	}
+}
+
+//Returns true if the orbits of the processed leaves cover all the weight-matching leaves of 
+//  every target weight.
+bool all_leaves_covered(leaf_orbits &orbits)
+{
+	for(int k=0;k<num_weights;k++)
+		if(orbits.num_covered[k]<orbits.num_matching[k])
+			return false;
+	return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //      THE FOLLOWING TWO FUNCTIONS ARE THE MAIN PARTS OF THE CODE THAT       //
 //     TEST ALL POSSIBLE COMBINATIONS OF THE TWO BODY TERMS TO ADD TO THE     //
@@ -200,60 +512,151 @@ void init()
 //                    HAMMING WEIGHT AS A POLYNOMIAL ARRAY                    //
 ////////////////////////////////////////////////////////////////////////////////
 
+//Writes a full polynomial list of weights[k] into the external_dir (see below).
+void spill_run(int k, Polynomial *poly_list, int num_polys);
+
+//Simplifies poly_list[index[0]],... with quick_simplify, see below.
+void quick_simplify_list(Polynomial *poly_list, int *index, int n, int wait, int random_jumps);
+
+//Builds the polynomial of a leaf of the recursion below: the bases plus the two body terms 
+//  encoded in code, plus the constant term if constant is true.
+void build_leaf_poly(int code,bool constant,Polynomial &poly, Polynomial &Base1, Polynomial &Base2)
+{
+	poly.num_terms=0;
+	for(int i=0;i<Base1.num_terms;i++)
+		poly.add_term(((uchar)1)^(Base1.poly[i]<<2));	
+	for(int i=0;i<Base2.num_terms;i++)
+		poly.add_term(((uchar)2)^(Base2.poly[i]<<2));	
+
+	int i=21;
+	while(code){	
+		i--;
+		if(code&(uchar)1)
+			poly.add_term(((uchar)1)^((uchar)2)^(second_order_monomials[i]<<2));
+		code=code>>1;
+	}
+	if(constant)
+    poly.add_term(((uchar)1)^((uchar)2));
+}
+
+//Adds the simplified polynomial of a leaf to poly_list (the list of weights[k]) if it is not 
+//  already among poly_list[first],...,poly_list[*num_polys-1]. A polynomial that any thread has 
+//  already found with exactly the same terms is rejected by the shared_set before this comparison. 
+//  In the external memory mode, a full list is written to the disk and emptied. num_found counts 
+//  the added polynomials for the progress reports.
+atomic<long> num_found(0);
+void add_leaf_poly(Polynomial &poly, Polynomial *poly_list, int *num_polys, int first, int k)
+{
+	if(!shared_set.insert(k,poly))
+		return ;
+	for(int i=first;i<*num_polys;i++)
+		if(poly_list[i]==poly)
+			return ;
+	poly_list[*num_polys]=poly;
+	(*num_polys)++;
+	num_found++;
+	if(external_dir && (*num_polys)>=MAX_NUM_POLYS){
+		spill_run(k,poly_list,*num_polys);
+		(*num_polys)=0;
+	}
+	if((*num_polys)>MAX_NUM_POLYS){
+		printf("\nERROR: Too many polynomials found\n");
+		abort();
+	}
+}
+
+//The leaves of weights[k] wait in leaves[k*PolyBatch::SIZE],... until num_leaves[k] reaches 
+//  PolyBatch::SIZE (or the enumeration of the base pair ends). Then they are simplified together 
+//  (see quick_simplify_list) and added to the list of weights[k] with add_leaf_poly.
+void flush_leaves(int k, Polynomial *leaves, int *num_leaves, Polynomial **poly_list, int *num_polys, int *first)
+{
+	Polynomial *waiting=leaves+k*PolyBatch::SIZE;
+	quick_simplify_list(waiting,NULL,num_leaves[k],trigger_wait,trigger_random_jumps);
+	for(int j=0;j<num_leaves[k];j++)
+		add_leaf_poly(waiting[j],poly_list[k],&num_polys[k],first[k],k);
+	num_leaves[k]=0;
+}
+
+//The level of rec at which the time limit is checked and the visited leaves are counted, i.e., 
+//  once every 2^(21-CHECK_LEVEL) leaves.
+const int CHECK_LEVEL=9;
+
 //The main recursive funciton. It will be called from the generate_poly_list 
 //  function below. This function encodes the polynomial truth table in ulong
-//  variable for faster processing.
-void rec(ulong table,int lev,int code,int &target,Polynomial &poly, Polynomial &Base1, Polynomial &Base2, Polynomial *poly_list, int *num_polys)
+//  variable for faster processing. Each leaf is routed to the list of every 
+//  target weight it matches (targets[k] is the target of weights[k]), through the 
+//  waiting leaves of flush_leaves. A leaf in the orbit of a processed leaf is skipped,
+//  and the recursion stops when the orbits cover all the leaves (see leaf_orbits). The
+//  visited leaves are added to leaves_done (if given). When the time for the 
+//  enumeration is up, the remaining leaves are skipped. Returns false if any leaf was 
+//  skipped because of the time limit.
+bool rec(ulong table,int lev,int code,int *targets,leaf_orbits &orbits,Polynomial *leaves,int *num_leaves, Polynomial &Base1, Polynomial &Base2, Polynomial **poly_list, int *num_polys, int *first, atomic<long> *leaves_done)
 {
 	if(lev==21){
 		int ham_w = hamming_weight(table);
-		if(ham_w==target || ham_w==64-target){
-			poly.num_terms=0;
-			for(int i=0;i<Base1.num_terms;i++)
-				poly.add_term(((uchar)1)^(Base1.poly[i]<<2));	
-			for(int i=0;i<Base2.num_terms;i++)
-				poly.add_term(((uchar)2)^(Base2.poly[i]<<2));	
-
-			int i=21;
-			while(code){	
-				i--;
-				if(code&(uchar)1)
-					poly.add_term(((uchar)1)^((uchar)2)^(second_order_monomials[i]<<2));
-				code=code>>1;
-			}
-			if(ham_w==64-target)
-	      poly.add_term(((uchar)1)^((uchar)2));
-			poly.quick_simplify(trigger_wait,trigger_random_jumps);
-			for(int i=0;i<*num_polys;i++)
-				if(poly_list[i]==poly)
-					return ;
-			poly_list[*num_polys]=poly;
-			(*num_polys)++;
-			if((*num_polys)>MAX_NUM_POLYS){
-				printf("\nERROR: Too many polynomials found\n");
-				abort();
+		for(int k=0;k<num_weights;k++)
+			if((ham_w==targets[k] || ham_w==64-targets[k]) && !leaf_covered(orbits,k,code)){
+				build_leaf_poly(code,ham_w==64-targets[k],leaves[k*PolyBatch::SIZE+num_leaves[k]],Base1,Base2);
+				num_leaves[k]++;
+				if(num_leaves[k]==PolyBatch::SIZE)
+					flush_leaves(k,leaves,num_leaves,poly_list,num_polys,first);
 			}
-		}
-		return ;
+		return true;
 	}
-	rec(table                        ,lev+1,code<<1    ,target,poly,Base1,Base2,poly_list,num_polys);
-	rec(table^second_order_table[lev],lev+1,(code<<1)^1,target,poly,Base1,Base2,poly_list,num_polys);
-	return ;
+	//At CHECK_LEVEL, a subtree whose leaves are all covered is skipped, and otherwise it is only 
+	//  dropped if the time is up.
+	bool complete=true,covered=(lev==CHECK_LEVEL && all_leaves_covered(orbits));
+	if(lev==CHECK_LEVEL && !covered && time_is_up(ENUMERATION_SHARE)){
+		out_of_time=true;
+		return false;
+	}
+	if(!covered){
+		complete&=rec(table                        ,lev+1,code<<1    ,targets,orbits,leaves,num_leaves,Base1,Base2,poly_list,num_polys,first,leaves_done);
+		complete&=rec(table^second_order_table[lev],lev+1,(code<<1)^1,targets,orbits,leaves,num_leaves,Base1,Base2,poly_list,num_polys,first,leaves_done);
+	}
+	if(lev==CHECK_LEVEL && leaves_done)
+		(*leaves_done)+=1L<<(21-CHECK_LEVEL);
+	return complete;
 }
 
 //This function takes two base polynomials, and places all possible polynomials with that base and
-//  given weight into the poly_list array. The num_polys will reflect the total number of 
-//  polynomials in the list and will be modified as we call this function. This function does one 
-//  quick level of polynomial simplification and do not add repreated polynomials. Lastly, it can 
-//  be called on the same poly_list over and over again and it will just add extra polynomials that 
-//  it finds to the list. 
+//  one of the target weights into the poly_list arrays (poly_list[k] receives the polynomials of 
+//  weights[k]). The num_polys will reflect the total number of polynomials in each list and will 
+//  be modified as we call this function. This function does one quick level of polynomial 
+//  simplification (PolyBatch::SIZE leaves at a time) and do not add repreated polynomials. 
+//  Lastly, it can be called on the same poly_list over and over again and it will just add extra
+//  polynomials that it finds to the list. 
+//  All target weights are handled in a single pass over the 2^21 combinations. If first is given,
+//  the new polynomials of weights[k] are only compared with poly_list[k][first[k]],... (this keeps
+//  the polynomials of each base pair separate when the cache is used). The visited leaves are 
+//  counted in leaves_done (if given). Only one leaf of each orbit of leaves is simplified (see 
+//  the ORBITS OF THE LEAVES section). Returns false if the time limit cut the enumeration.
 
-void generate_poly_list(Polynomial &Base1,Polynomial &Base2, int weight,Polynomial *poly_list, int &num_polys)
+bool generate_poly_list(Polynomial &Base1,Polynomial &Base2,Polynomial **poly_list, int *num_polys, int *first=NULL, atomic<long> *leaves_done=NULL)
 {
-	Polynomial poly, buffers[3];
-	poly.set_buffers(buffers);
-	int target=weight-hamming_weight(Base1.truth_table())-hamming_weight(Base2.truth_table());
-	rec(Base1.truth_table()^Base2.truth_table(),0,0,target,poly,Base1,Base2,poly_list,&num_polys);
+	int base_weight=hamming_weight(Base1.truth_table())+hamming_weight(Base2.truth_table());
+	int *targets=new int[num_weights];
+	int *zeros=new int[num_weights];
+	Polynomial *leaves=new Polynomial[num_weights*PolyBatch::SIZE];
+	int *num_leaves=new int[num_weights];
+	for(int k=0;k<num_weights;k++){
+		targets[k]=weights[k]-base_weight;
+		zeros[k]=0;
+		num_leaves[k]=0;
+	}
+	if(!first)
+		first=zeros;
+	leaf_orbits orbits;
+	init_leaf_orbits(orbits,Base1,Base2,targets);
+	bool complete=rec(Base1.truth_table()^Base2.truth_table(),0,0,targets,orbits,leaves,num_leaves,Base1,Base2,poly_list,num_polys,first,leaves_done);
+	for(int k=0;k<num_weights;k++)
+		flush_leaves(k,leaves,num_leaves,poly_list,num_polys,first);
+	free_leaf_orbits(orbits);
+	delete[] targets;
+	delete[] zeros;
+	delete[] leaves;
+	delete[] num_leaves;
+	return complete;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -262,44 +665,577 @@ void generate_poly_list(Polynomial &Base1,Polynomial &Base2, int weight,Polynomi
 //      AS MUCH AS POSSIBLE AND REMOVE THE AFFINE EQUIVALENT POLYNOMIALS.     //
 ////////////////////////////////////////////////////////////////////////////////
 
-//The following function is usually called from the simplify_poly_list function.
-void shorten_poly_list(int wait, int random_jumps, Polynomial *poly_list, int &num_polys)
+//Input data structure of the threads of remove_equivalent_polys.
+struct dedup_data {
+	Polynomial *poly_list;
+	bool *active_poly;
+	int *order,*bucket_start;
+	int num_buckets;
+	atomic<int> *next_bucket;
+	int *tags,*parent;
+};
+
+//Compares the polynomials inside the buckets. The buckets are taken one by one from the shared 
+//  next_bucket counter, so the threads stay busy even if the buckets have very different sizes.
+void *dedup_thread_function(void *var)
 {
-	Polynomial buffers[3];
-	bool *active_poly=new bool[MAX_NUM_POLYS];
-	for(int i=0;i<num_polys;i++)
-		active_poly[i]=true;
+	struct dedup_data *data;
+	data = (struct dedup_data *) var;
+	int b;
+	while((b=(*data->next_bucket)++)<data->num_buckets)
+		for(int x=data->bucket_start[b];x<data->bucket_start[b+1];x++){
+			int i=data->order[x];
+			if(data->active_poly[i])
+				for(int y=x+1;y<data->bucket_start[b+1];y++){
+					int j=data->order[y];
+					if(data->active_poly[j] && data->poly_list[i]==data->poly_list[j]){
+						data->active_poly[j]=false;
+						if(data->tags)
+							data->parent[data->tags[j]]=data->tags[i];
+					}
+				}
+		}
+	return NULL;
+}
+
+//The pool of helper threads of remove_equivalent_polys. The helpers are created once by 
+//  start_dedup_pool, pinned to their CPUs, and then wait for a job (the dedup_data of a call of 
+//  remove_equivalent_polys). The pool is only started by the main thread after the worker threads 
+//  are joined, so the calls from the worker threads (in shorten_poly_list) never use it and 
+//  compare their buckets serially.
+int dedup_num_helpers=0;
+pthread_mutex_t dedup_mutex=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t dedup_job_ready=PTHREAD_COND_INITIALIZER,dedup_job_done=PTHREAD_COND_INITIALIZER;
+dedup_data *dedup_job=NULL;
+long dedup_generation=0;     //Incremented for every new job.
+int dedup_busy=0;            //The number of helpers that have not finished the current job.
+
+void *dedup_helper_function(void *)
+{
+	long done_generation=0;
+	pthread_mutex_lock(&dedup_mutex);
+	while(true){
+		while(dedup_generation==done_generation)
+			pthread_cond_wait(&dedup_job_ready,&dedup_mutex);
+		done_generation=dedup_generation;
+		dedup_data *job=dedup_job;
+		pthread_mutex_unlock(&dedup_mutex);
+		dedup_thread_function((void *)job);
+		pthread_mutex_lock(&dedup_mutex);
+		dedup_busy--;
+		if(dedup_busy==0)
+			pthread_cond_signal(&dedup_job_done);
+	}
+	return NULL;
+}
+
+//Starts one helper thread on each CPU of cpus. The helpers live until the end of the process.
+void start_dedup_pool(vector<int> cpus)
+{
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	cpu_set_t cpu_set;
+	pthread_t thread;
+	for(size_t i=0;i<cpus.size();i++){
+		CPU_ZERO(&cpu_set);
+		CPU_SET(cpus[i],&cpu_set);
+		pthread_attr_setaffinity_np(&attr,sizeof(cpu_set),&cpu_set);
+		if(pthread_create(&thread,&attr,dedup_helper_function,NULL)){
+			printf("Error:unable to create thread.");
+			exit(-1);
+		}
+	}
+	pthread_attr_destroy(&attr);
+	dedup_num_helpers=cpus.size();
+}
+
+//Sets active_poly[j]=false for every polynomial that is equal (==) to a polynomial with a smaller 
+//  index. Equal polynomials have the same invariants (see invariants in the Polynomial class), so 
+//  the list is split into buckets of polynomials with the same invariants, and only polynomials 
+//  inside the same bucket are compared. The buckets are processed by the calling thread and the 
+//  helpers of the dedup pool, if it is started.
+void remove_equivalent_polys(Polynomial *poly_list, int num_polys, bool *active_poly, int *tags, int *parent)
+{
+	const int NI=Polynomial::NUM_INVARIANTS;
+	int *inv=new int[num_polys*NI];
+	int *order=new int[num_polys];
 	for(int i=0;i<num_polys;i++){
-		poly_list[i].set_buffers(buffers);
-		poly_list[i].quick_simplify(wait,random_jumps);
+		poly_list[i].invariants(inv+i*NI);
+		order[i]=i;
 	}
-	for(int i=0;i<num_polys;i++)
-		if(active_poly[i])
-			for(int j=i+1;j<num_polys;j++)
-				if(poly_list[i]==poly_list[j])
-					active_poly[j]=false;
+	//Stable sort keeps the indices increasing inside each bucket.
+	std::stable_sort(order,order+num_polys,[inv,NI](int a,int b){
+		return std::lexicographical_compare(inv+a*NI,inv+(a+1)*NI,inv+b*NI,inv+(b+1)*NI);
+	});
+	//Only the buckets with more than one polynomial are kept.
+	int *bucket_start=new int[num_polys+1];
+	int num_buckets=0,num_compared=0;
+	for(int x=0,y;x<num_polys;x=y){
+		for(y=x+1;y<num_polys;y++)
+			if(!std::equal(inv+order[x]*NI,inv+(order[x]+1)*NI,inv+order[y]*NI))
+				break;
+		if(y-x>1){
+			for(int z=x;z<y;z++)
+				order[num_compared+z-x]=order[z];
+			bucket_start[num_buckets]=num_compared;
+			num_buckets++;
+			num_compared+=y-x;
+		}
+	}
+	bucket_start[num_buckets]=num_compared;
+	delete[] inv;
+
+	atomic<int> next_bucket(0);
+	dedup_data data={poly_list,active_poly,order,bucket_start,num_buckets,&next_bucket,tags,parent};
+	if(dedup_num_helpers>0 && num_buckets>1 && num_compared>=64){
+		pthread_mutex_lock(&dedup_mutex);
+		dedup_job=&data;
+		dedup_busy=dedup_num_helpers;
+		dedup_generation++;
+		pthread_cond_broadcast(&dedup_job_ready);
+		pthread_mutex_unlock(&dedup_mutex);
+		dedup_thread_function((void *)&data);
+		pthread_mutex_lock(&dedup_mutex);
+		while(dedup_busy>0)
+			pthread_cond_wait(&dedup_job_done,&dedup_mutex);
+		pthread_mutex_unlock(&dedup_mutex);
+	}
+	else
+		dedup_thread_function((void *)&data);
+	delete[] order;
+	delete[] bucket_start;
+}
+
+//Removes the polynomials with active_poly[i]==false from the list (and their tags).
+void compact_poly_list(Polynomial *poly_list, int &num_polys, bool *active_poly, int *tags)
+{
 	int new_num_polys=0;
 	for(int i=0;i<num_polys;i++)
 		if(active_poly[i]){
-			if(i>new_num_polys)
+			if(i>new_num_polys){
 				poly_list[new_num_polys]=poly_list[i];
+				if(tags)
+					tags[new_num_polys]=tags[i];
+			}
 			new_num_polys++;
 		}
 	num_polys=new_num_polys;
 }
 
-void simplify_poly_list(Polynomial *poly_list, int &num_polys)
+//Runs quick_simplify(wait,random_jumps) on poly_list[index[0]],...,poly_list[index[n-1]], or on 
+//  poly_list[0],...,poly_list[n-1] if index is NULL. With the default strategy (greedy_search), 
+//  the polynomials are simplified PolyBatch::SIZE at a time (see poly_batch.h). With the other 
+//  strategies, each polynomial also goes through canonicalize before the comparisons. After the 
+//  time is up, the polynomials are only sorted, as quick_simplify does then.
+void quick_simplify_list(Polynomial *poly_list, int *index, int n, int wait, int random_jumps)
+{
+	if(Polynomial::strategy!=greedy_search){
+		for(int i=0;i<n;i++){
+			Polynomial &poly=poly_list[index?index[i]:i];
+			poly.quick_simplify(wait,random_jumps);
+			canonicalize(poly,wait,random_jumps);
+		}
+		return ;
+	}
+	PolyBatch batch;
+	Polynomial *polys[PolyBatch::SIZE];
+	for(int i=0;i<n;i+=PolyBatch::SIZE){
+		int m=min(n-i,(int)PolyBatch::SIZE);
+		for(int j=0;j<m;j++)
+			polys[j]=&poly_list[index?index[i+j]:i+j];
+		if(time_is_up()){
+			out_of_time=true;
+			for(int j=0;j<m;j++)
+				polys[j]->sort();
+			continue;
+		}
+		batch.load(polys,m);
+		batch.greedy_search(wait,random_jumps);
+		batch.store(polys);
+	}
+}
+
+//The following function is usually called from the simplify_poly_list function.
+//  If tags is given, tags[i] labels poly_list[i] and moves with it when the list is shortened. 
+//  When a polynomial is removed because it is equivalent to an earlier one, the merge is 
+//  recorded as parent[removed tag]=kept tag, so the class of every original polynomial can 
+//  be recovered afterwards (see find_parent).
+void shorten_poly_list(int wait, int random_jumps, Polynomial *poly_list, int &num_polys, int *tags=NULL, int *parent=NULL)
+{
+	bool *active_poly=new bool[num_polys];
+	for(int i=0;i<num_polys;i++)
+		active_poly[i]=true;
+	quick_simplify_list(poly_list,NULL,num_polys,wait,random_jumps);
+	remove_equivalent_polys(poly_list,num_polys,active_poly,tags,parent);
+	compact_poly_list(poly_list,num_polys,active_poly,tags);
+	delete[] active_poly;
+}
+
+//Follows the merges recorded by shorten_poly_list and returns the tag of the polynomial that 
+//  represents the class of tag t. Tags that were never merged must satisfy parent[t]==t.
+int find_parent(int *parent,int t)
+{
+	while(parent[t]!=t)
+		t=parent[t];
+	return t;
+}
+
+//Effort levels of the adaptive schedule of simplify_poly_list. The wait and random_jumps of 
+//  quick_simplify for a polynomial go one level up each time it stays unchanged for 
+//  ESCALATE_ROUNDS more rounds.
+const int NUM_LEVELS=2;
+const int level_wait[NUM_LEVELS]={50,100};
+const int level_random_jumps[NUM_LEVELS]={5,10};
+const int ESCALATE_ROUNDS=5;
+//The number of rounds of simplify_poly_list never exceeds MAX_ROUNDS.
+const int MAX_ROUNDS=220;
+
+//Returns the number of polynomials of the list whose fingerprint (see affine_fingerprint) is 
+//  different from the fingerprints of all other polynomials of the list, and sets their 
+//  unchanged counter to stable_rounds. Such a polynomial is provably alone in its class, so it 
+//  needs no more simplification.
+int retire_distinct_polys(int num_polys, int *tags, ulong *fingerprint, int *unchanged)
+{
+	vector<ulong> sorted(num_polys);
+	for(int i=0;i<num_polys;i++)
+		sorted[i]=fingerprint[tags[i]];
+	std::sort(sorted.begin(),sorted.end());
+	int num_distinct=0;
+	for(int i=0;i<num_polys;i++){
+		ulong f=fingerprint[tags[i]];
+		auto range=std::equal_range(sorted.begin(),sorted.end(),f);
+		if(range.second-range.first==1){
+			unchanged[tags[i]]=stable_rounds;
+			num_distinct++;
+		}
+	}
+	return num_distinct;
+}
+
+//True if all the polynomials left by the last call of simplify_poly_list have different 
+//  fingerprints, i.e., they are proven to be in different classes.
+bool classes_distinct=false;
+
+//After two passes of shorten_poly_list on the whole list, this function simplifies the list in 
+//  rounds. In each round, only the polynomials that changed (got fewer terms than ever before or 
+//  absorbed an equivalent polynomial) in the last stable_rounds rounds are simplified again, with more effort the longer 
+//  they stay unchanged, and the equivalent polynomials are removed. A polynomial whose affine 
+//  fingerprint is not shared by any other polynomial of the list is not simplified any more 
+//  (see retire_distinct_polys), so only the groups of polynomials with the same fingerprint are 
+//  worked on. It stops when the number of polynomials is the same for stable_rounds rounds, when 
+//  every polynomial is stable, or when all fingerprints are different, i.e., every polynomial is 
+//  proven to be in a different class (then classes_distinct is set). It also stops when the time
+//  is up (see time_is_up).
+//  tags and parent are as in shorten_poly_list; the tags must be between 0 and num_polys-1.
+void simplify_poly_list(Polynomial *poly_list, int &num_polys, int *tags=NULL, int *parent=NULL)
+{
+	int n=num_polys;
+	int *own_tags=NULL,*own_parent=NULL;
+	if(!tags){
+		//The tags are also needed to keep track of the unchanged rounds of each polynomial.
+		tags=own_tags=new int[n];
+		parent=own_parent=new int[n];
+		for(int i=0;i<n;i++)
+			tags[i]=parent[i]=i;
+	}
+	shorten_poly_list(10,3,poly_list,num_polys,tags,parent);
+	shorten_poly_list(50,5,poly_list,num_polys,tags,parent);
+
+	int *unchanged=new int[n];
+	int *best_num_terms=new int[n];
+	bool *active_poly=new bool[n];
+	//The indices of the polynomials selected in a round, for each level.
+	int **selected=new int*[NUM_LEVELS],num_level[NUM_LEVELS];
+	for(int l=0;l<NUM_LEVELS;l++)
+		selected[l]=new int[n];
+	for(int i=0;i<n;i++)
+		unchanged[i]=0;
+	//The fingerprints do not change under simplification, so they are computed only once.
+	ulong *fingerprint=new ulong[n];
+	for(int i=0;i<num_polys;i++){
+		best_num_terms[tags[i]]=poly_list[i].num_terms;
+		fingerprint[tags[i]]=affine_fingerprint(poly_list[i]);
+	}
+	int rounds=0,same_rounds=0;
+	while(same_rounds<stable_rounds && rounds<MAX_ROUNDS){
+		if(retire_distinct_polys(num_polys,tags,fingerprint,unchanged)==num_polys)
+			break;
+		if(time_is_up()){
+			out_of_time=true;
+			break;
+		}
+		rounds++;
+		int old_num_polys=num_polys,num_selected=0;
+		for(int l=0;l<NUM_LEVELS;l++)
+			num_level[l]=0;
+		for(int i=0;i<num_polys;i++){
+			int t=tags[i];
+			active_poly[i]=true;
+			if(unchanged[t]>=stable_rounds)
+				continue;
+			num_selected++;
+			int level=min(unchanged[t]/ESCALATE_ROUNDS,NUM_LEVELS-1);
+			selected[level][num_level[level]]=i;
+			num_level[level]++;
+		}
+		for(int l=0;l<NUM_LEVELS;l++){
+			quick_simplify_list(poly_list,selected[l],num_level[l],level_wait[l],level_random_jumps[l]);
+			for(int x=0;x<num_level[l];x++){
+				int i=selected[l][x],t=tags[i];
+				if(poly_list[i].num_terms<best_num_terms[t]){
+					best_num_terms[t]=poly_list[i].num_terms;
+					unchanged[t]=0;
+				}
+				else
+					unchanged[t]++;
+			}
+		}
+		if(num_selected==0)
+			break;
+		remove_equivalent_polys(poly_list,num_polys,active_poly,tags,parent);
+		for(int i=0;i<num_polys;i++)
+			if(!active_poly[i]){
+				int t=parent[tags[i]];
+				unchanged[t]=0;
+				best_num_terms[t]=min(best_num_terms[t],best_num_terms[tags[i]]);
+			}
+		compact_poly_list(poly_list,num_polys,active_poly,tags);
+		if(num_polys==old_num_polys)
+			same_rounds++;
+		else
+			same_rounds=0;
+		if(progress_due())
+			cout<<"\nProgress: "<<elapsed_seconds()<<" seconds, round "<<rounds<<", "<<num_polys
+			    <<" polynomials left, "<<num_selected<<" simplified in this round"<<endl;
+	}
+	classes_distinct=(retire_distinct_polys(num_polys,tags,fingerprint,unchanged)==num_polys);
+	delete[] unchanged;
+	delete[] best_num_terms;
+	delete[] fingerprint;
+	for(int l=0;l<NUM_LEVELS;l++)
+		delete[] selected[l];
+	delete[] selected;
+	delete[] active_poly;
+	delete[] own_tags;
+	delete[] own_parent;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                            EXTERNAL MEMORY MODE                            //
+//      THE POLYNOMIAL LISTS ARE WRITTEN TO THE DISK AS RUNS SORTED BY THE    //
+//      HASH OF THEIR INVARIANTS, AND ARE MERGED AND SIMPLIFIED BUCKET BY     //
+//        BUCKET, SO AT MOST MAX_NUM_POLYS POLYNOMIALS OF A LIST ARE IN       //
+//                              MEMORY AT A TIME.                             //
+////////////////////////////////////////////////////////////////////////////////
+
+//A run is a binary file of records: the hash of the invariants (ulong), the number of terms 
+//  (int) and the terms (uchar each), sorted by the hash. Equal polynomials (==) have the same 
+//  invariants, so they have the same hash and end up next to each other when runs are merged.
+
+//The run files of each target weight that are not merged yet, and the number of written runs 
+//  and polynomials.
+vector<string> *run_files;
+pthread_mutex_t run_files_mutex=PTHREAD_MUTEX_INITIALIZER;
+atomic<int> num_runs(0);
+atomic<long> num_spilled(0);
+
+ulong invariant_hash(Polynomial &poly)
+{
+	int inv[Polynomial::NUM_INVARIANTS];
+	poly.invariants(inv);
+	ulong h=0xcbf29ce484222325UL;
+	for(int i=0;i<Polynomial::NUM_INVARIANTS;i++){
+		h^=(ulong)inv[i];
+		h*=0x100000001b3UL;
+	}
+	return h;
+}
+
+void write_record(ofstream &file, ulong hash, Polynomial &poly)
 {
-	shorten_poly_list(10,3,poly_list,num_polys);
-	shorten_poly_list(50,5,poly_list,num_polys);
-	for(int i=0;i<100;i++)
-		shorten_poly_list(50,5,poly_list,num_polys);
-	for(int i=0;i<10;i++)
-		shorten_poly_list(100,10,poly_list,num_polys);
-	for(int i=0;i<100;i++)
-		shorten_poly_list(50,5,poly_list,num_polys);
-	for(int i=0;i<10;i++)
-		shorten_poly_list(100,10,poly_list,num_polys);
+	file.write((char *)&hash,sizeof(hash));
+	file.write((char *)&poly.num_terms,sizeof(poly.num_terms));
+	file.write((char *)poly.poly,poly.num_terms);
+}
+
+bool read_record(ifstream &file, ulong &hash, Polynomial &poly)
+{
+	if(!file.read((char *)&hash,sizeof(hash)))
+		return false;
+	file.read((char *)&poly.num_terms,sizeof(poly.num_terms));
+	file.read((char *)poly.poly,poly.num_terms);
+	return (bool)file;
+}
+
+//Writes poly_list sorted by the invariant hashes into a new run file and returns its name.
+string write_run(int k, Polynomial *poly_list, int num_polys)
+{
+	ulong *hash=new ulong[num_polys];
+	int *order=new int[num_polys];
+	for(int i=0;i<num_polys;i++){
+		hash[i]=invariant_hash(poly_list[i]);
+		order[i]=i;
+	}
+	std::sort(order,order+num_polys,[hash](int a,int b){return hash[a]<hash[b];});
+	string name=string(external_dir)+"/run_"+to_string(weights[k])+"_"+to_string(num_runs++)+".bin";
+	ofstream file(name.c_str(),ios::binary);
+	for(int i=0;i<num_polys;i++)
+		write_record(file,hash[order[i]],poly_list[order[i]]);
+	file.close();
+	if(file.fail()){
+		printf("Error:unable to write the run file %s\n",name.c_str());
+		exit(-1);
+	}
+	delete[] hash;
+	delete[] order;
+	return name;
+}
+
+void spill_run(int k, Polynomial *poly_list, int num_polys)
+{
+	if(num_polys==0)
+		return ;
+	string name=write_run(k,poly_list,num_polys);
+	num_spilled+=num_polys;
+	pthread_mutex_lock(&run_files_mutex);
+	run_files[k].push_back(name);
+	pthread_mutex_unlock(&run_files_mutex);
+}
+
+//At most MERGE_FAN_IN runs are opened at the same time by merge_runs.
+const int MERGE_FAN_IN=64;
+
+//Merges at most MERGE_FAN_IN runs into one run file (out_name), removing the equivalent 
+//  polynomials of each bucket of equal hashes with remove_equivalent_polys. The input runs are 
+//  deleted. Returns the number of polynomials in the merged run.
+long merge_run_group(vector<string> &runs, const string &out_name)
+{
+	int n=runs.size();
+	ifstream *files=new ifstream[n];
+	ulong *hash=new ulong[n];
+	Polynomial *head=new Polynomial[n];
+	bool *valid=new bool[n];
+	for(int i=0;i<n;i++){
+		files[i].open(runs[i].c_str(),ios::binary);
+		valid[i]=read_record(files[i],hash[i],head[i]);
+	}
+	ofstream out(out_name.c_str(),ios::binary);
+	vector<Polynomial> bucket;
+	long count=0;
+	while(true){
+		int m=-1;
+		for(int i=0;i<n;i++)
+			if(valid[i] && (m==-1 || hash[i]<hash[m]))
+				m=i;
+		if(m==-1)
+			break;
+		ulong h=hash[m];
+		bucket.clear();
+		for(int i=0;i<n;i++)
+			while(valid[i] && hash[i]==h){
+				bucket.push_back(head[i]);
+				valid[i]=read_record(files[i],hash[i],head[i]);
+			}
+		int num_polys=bucket.size();
+		bool *active_poly=new bool[num_polys];
+		for(int i=0;i<num_polys;i++)
+			active_poly[i]=true;
+		if(num_polys>1)
+			remove_equivalent_polys(&bucket[0],num_polys,active_poly,NULL,NULL);
+		for(int i=0;i<num_polys;i++)
+			if(active_poly[i]){
+				write_record(out,h,bucket[i]);
+				count++;
+			}
+		delete[] active_poly;
+	}
+	out.close();
+	if(out.fail()){
+		printf("Error:unable to write the run file %s\n",out_name.c_str());
+		exit(-1);
+	}
+	for(int i=0;i<n;i++){
+		files[i].close();
+		remove(runs[i].c_str());
+	}
+	delete[] files;
+	delete[] hash;
+	delete[] head;
+	delete[] valid;
+	return count;
+}
+
+//Merges any number of runs into out_name as merge_run_group does, in several levels if there 
+//  are more than MERGE_FAN_IN runs.
+long merge_runs(vector<string> &runs, const string &out_name)
+{
+	vector<string> level=runs;
+	while(level.size()>(size_t)MERGE_FAN_IN){
+		vector<string> next_level;
+		for(size_t i=0;i<level.size();i+=MERGE_FAN_IN){
+			vector<string> group(level.begin()+i,level.begin()+min(level.size(),i+MERGE_FAN_IN));
+			string name=string(external_dir)+"/run_merge_"+to_string(num_runs++)+".bin";
+			merge_run_group(group,name);
+			next_level.push_back(name);
+		}
+		level=next_level;
+	}
+	return merge_run_group(level,out_name);
+}
+
+//With the external memory mode, this function is used instead of mix_poly_lists. The runs of 
+//  weights[k] are merged. As long as the merged list has more than MAX_NUM_POLYS polynomials, it 
+//  is read in chunks of MAX_NUM_POLYS polynomials, each chunk is simplified with one 
+//  shorten_poly_list pass and written as a new run, and the runs are merged again. This stops 
+//  when the list fits in MAX_NUM_POLYS or its length does not change for 3 rounds. The list is 
+//  then read into final_poly_list (allocated here) and simplified with simplify_poly_list.
+void external_mix_poly_lists(Polynomial *&final_poly_list,int &final_num_polys, int k)
+{
+	string merged=string(external_dir)+"/merged_"+to_string(weights[k])+".bin";
+	long num_polys=merge_runs(run_files[k],merged);
+	run_files[k].clear();
+	int same_rounds=0;
+	Polynomial *chunk=new Polynomial[MAX_NUM_POLYS];
+	ulong h;
+	while(num_polys>MAX_NUM_POLYS && same_rounds<3){
+		if(time_is_up()){
+			out_of_time=true;
+			break;
+		}
+		ifstream file(merged.c_str(),ios::binary);
+		int n=0;
+		bool more=true;
+		while(more){
+			more=read_record(file,h,chunk[n]);
+			if(more)
+				n++;
+			if(n==MAX_NUM_POLYS || (!more && n)){
+				shorten_poly_list(50,5,chunk,n);
+				run_files[k].push_back(write_run(k,chunk,n));
+				n=0;
+			}
+		}
+		file.close();
+		long new_num_polys=merge_runs(run_files[k],merged);
+		run_files[k].clear();
+		if(new_num_polys==num_polys)
+			same_rounds++;
+		else
+			same_rounds=0;
+		num_polys=new_num_polys;
+	}
+	delete[] chunk;
+	if(num_polys>MAX_NUM_POLYS)
+		cout<<"(the final list of "<<num_polys<<" polynomials is larger than MAX_NUM_POLYS) ";
+	final_num_polys=num_polys;
+	final_poly_list=new Polynomial[final_num_polys];
+	ifstream file(merged.c_str(),ios::binary);
+	for(int i=0;i<final_num_polys;i++)
+		read_record(file,h,final_poly_list[i]);
+	file.close();
+	remove(merged.c_str());
+	simplify_poly_list(final_poly_list,final_num_polys);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -311,47 +1247,275 @@ void *thread_function(void *var)
 {
 	struct thread_data *data;
 	data = (struct thread_data *) var;
+	//The lists are allocated here, by the thread that is already pinned to its CPU, so that their
+	//  memory is first touched (and therefore placed) on the NUMA node of that CPU.
+	for(int k=0;k<num_weights;k++)
+		data->poly_list[k] = new Polynomial[MAX_NUM_POLYS];
 	Polynomial Base1, Base2;
+	bool complete;
 	for(int i=0;i<data->num_bases;i++){
 		Base1.clear();
 		Base2.clear();
 		Base1=data->Base1[i];
 		Base2=data->Base2[i];
-		generate_poly_list(Base1,Base2,data->weight,data->poly_list,data->num_polys);
+		if(data->pair_num_polys){
+			//With the cache, the polynomials of each base pair are kept and shortened separately, 
+			//  so that the classes found from each base pair can be stored in the cache.
+			int *first=new int[num_weights];
+			for(int k=0;k<num_weights;k++)
+				first[k]=data->num_polys[k];
+			complete=generate_poly_list(Base1,Base2,data->poly_list,data->num_polys,first,&data->leaves_done);
+			for(int k=0;k<num_weights;k++){
+				int n=data->num_polys[k]-first[k];
+				shorten_poly_list(10,3,data->poly_list[k]+first[k],n);
+				shorten_poly_list(20,4,data->poly_list[k]+first[k],n);
+				data->pair_num_polys[i][k]=n;
+				data->num_polys[k]=first[k]+n;
+			}
+			delete[] first;
+		}
+		else
+			complete=generate_poly_list(Base1,Base2,data->poly_list,data->num_polys,NULL,&data->leaves_done);
+		if(complete)
+			data->pairs_done++;
+	}
+	if(data->pair_num_polys)
+		pthread_exit(NULL);
+	for(int k=0;k<num_weights;k++){
+		shorten_poly_list(10,3,data->poly_list[k],data->num_polys[k]);
+		shorten_poly_list(20,4,data->poly_list[k],data->num_polys[k]);
+		if(external_dir){
+			spill_run(k,data->poly_list[k],data->num_polys[k]);
+			data->num_polys[k]=0;
+		}
 	}
-	shorten_poly_list(10,3,data->poly_list,data->num_polys);
-	shorten_poly_list(20,4,data->poly_list,data->num_polys);
   pthread_exit(NULL);
 }
 
-//This function mixes the polynomial lists that outputs of each thread
-void mix_poly_lists(Polynomial *final_poly_list,int &final_num_polys, thread_data *data)
+//True once all the threads above are done.
+atomic<bool> enumeration_done(false);
+
+//The thread of the progress reports during the enumeration. Every progress_interval seconds, it
+//  prints the number of enumerated base pairs, the leaves of rec() visited so far (of 2^21 per 
+//  base pair), and the number of polynomials found (see add_leaf_poly). var points to the
+//  thread_data of all NUM_THREADS threads.
+void *progress_function(void *var)
+{
+	struct thread_data *data;
+	data = (struct thread_data *) var;
+	long total_pairs=0;
+	for(int i=0;i<NUM_THREADS;i++)
+		total_pairs+=data[i].num_bases;
+	while(!enumeration_done){
+		usleep(100000);
+		if(!progress_due())
+			continue;
+		long pairs=0,leaves=0;
+		for(int i=0;i<NUM_THREADS;i++){
+			pairs+=data[i].pairs_done;
+			leaves+=data[i].leaves_done;
+		}
+		printf("Progress: %.1f seconds, %ld of %ld base pairs done, %ld of %ld leaves, %ld polynomials found\n",
+		       elapsed_seconds(),pairs,total_pairs,leaves,total_pairs<<21,(long)num_found);
+		fflush(stdout);
+	}
+	return NULL;
+}
+
+//This function mixes the polynomial lists of the target weight weights[k] that 
+//  outputs of each thread
+void mix_poly_lists(Polynomial *final_poly_list,int &final_num_polys, thread_data *data, int k)
 {
 	int c=0;
 	for(int i=0;i<NUM_THREADS;i++)
-		for(int j=0;j<data[i].num_polys;j++){
-			final_poly_list[c]=data[i].poly_list[j];
+		for(int j=0;j<data[i].num_polys[k];j++){
+			final_poly_list[c]=data[i].poly_list[k][j];
 			c++;
 		}
 	simplify_poly_list(final_poly_list,final_num_polys);
 	return ;
 }
 
+//With the cache, this function is used instead of mix_poly_lists. Only the polynomials of the
+//  base pairs that are not in the cache are simplified, and the classes found from each of these 
+//  base pairs are added to the cache. The new representatives are simplified again together with 
+//  the cached representatives that have the same fingerprint (see affine_fingerprint), so that a 
+//  new representative that is affine equivalent to a cached one, but stuck in a different 
+//  minimal form, is not cached as a second class. At the end, final_poly_list is allocated and filled with the representatives of all the base 
+//  pairs of the instruction file (cached or not).
+void mix_poly_lists_with_cache(Polynomial *&final_poly_list,int &final_num_polys, thread_data *data, int k)
+{
+	int num_new=0;
+	for(int i=0;i<NUM_THREADS;i++)
+		num_new+=data[i].num_polys[k];
+	Polynomial *new_poly_list=new Polynomial[num_new];
+	int *tags=new int[num_new];
+	int *parent=new int[num_new];
+	int *pair_of=new int[num_new];
+	int c=0;
+	for(int i=0;i<NUM_THREADS;i++){
+		int first=0;
+		for(int j=0;j<data[i].num_bases;j++){
+			int n=data[i].pair_num_polys[j][k];
+			if(cache.find_pair(weights[k],data[i].Base1[j],data[i].Base2[j])==-1){
+				int pair=cache.add_pair(weights[k],data[i].Base1[j],data[i].Base2[j]);
+				for(int l=first;l<first+n;l++){
+					new_poly_list[c]=data[i].poly_list[k][l];
+					tags[c]=c;
+					parent[c]=c;
+					pair_of[c]=pair;
+					c++;
+				}
+			}
+			first+=n;
+		}
+	}
+	num_new=c;
+	simplify_poly_list(new_poly_list,num_new,tags,parent);
+	//The joint list has the cached representatives with the fingerprint of a new representative
+	//  first, so that they are kept when a new representative is found equivalent to them.
+	vector<int> cached;
+	for(int i=0;i<num_new;i++){
+		vector<int> same=cache.fingerprint_reps(weights[k],affine_fingerprint(new_poly_list[i]));
+		for(size_t j=0;j<same.size();j++)
+			if(std::find(cached.begin(),cached.end(),same[j])==cached.end())
+				cached.push_back(same[j]);
+	}
+	int num_cached=cached.size(),num_joint=num_cached+num_new;
+	Polynomial *joint_poly_list=new Polynomial[num_joint];
+	int *joint_tags=new int[num_joint];
+	int *joint_parent=new int[num_joint];
+	for(int i=0;i<num_joint;i++){
+		if(i<num_cached)
+			joint_poly_list[i]=cache.get_rep(cached[i]);
+		else
+			joint_poly_list[i]=new_poly_list[i-num_cached];
+		joint_tags[i]=joint_parent[i]=i;
+	}
+	if(num_cached>0)
+		simplify_poly_list(joint_poly_list,num_joint,joint_tags,joint_parent);
+	int *joint_rep=new int[num_cached+num_new];
+	for(int i=0;i<num_joint;i++){
+		int t=joint_tags[i],rep;
+		if(t<num_cached)
+			rep=cached[t];
+		else{
+			rep=cache.find_rep(weights[k],joint_poly_list[i]);
+			if(rep==-1)
+				rep=cache.add_rep(weights[k],joint_poly_list[i]);
+		}
+		joint_rep[t]=rep;
+	}
+	int *rep_of=new int[c];
+	for(int i=0;i<num_new;i++)
+		rep_of[tags[i]]=joint_rep[find_parent(joint_parent,num_cached+i)];
+	for(int t=0;t<c;t++)
+		cache.add_pair_rep(pair_of[t],rep_of[find_parent(parent,t)]);
+	delete[] new_poly_list;
+	delete[] tags;
+	delete[] parent;
+	delete[] pair_of;
+	delete[] rep_of;
+	delete[] joint_poly_list;
+	delete[] joint_tags;
+	delete[] joint_parent;
+	delete[] joint_rep;
+
+	vector<int> reps;
+	for(int i=0;i<num_bases;i++){
+		vector<int> &pair_reps=cache.pair_reps(cache.find_pair(weights[k],all_Base1[i],all_Base2[i]));
+		for(size_t j=0;j<pair_reps.size();j++)
+			if(std::find(reps.begin(),reps.end(),pair_reps[j])==reps.end())
+				reps.push_back(pair_reps[j]);
+	}
+	final_num_polys=reps.size();
+	final_poly_list=new Polynomial[final_num_polys];
+	for(int i=0;i<final_num_polys;i++)
+		final_poly_list[i]=cache.get_rep(reps[i]);
+	return ;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                       THE CPUS AVAILABLE TO THE PROCESS                    //
+////////////////////////////////////////////////////////////////////////////////
+
+//Returns the list of CPUs in the affinity mask of the process (set by taskset, numactl, or 
+//  a cpuset cgroup).
+vector<int> allowed_cpus()
+{
+	vector<int> cpus;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(sched_getaffinity(0,sizeof(set),&set)==0)
+		for(int i=0;i<CPU_SETSIZE;i++)
+			if(CPU_ISSET(i,&set))
+				cpus.push_back(i);
+	if(cpus.empty())
+		for(int i=0;i<sysconf(_SC_NPROCESSORS_ONLN);i++)
+			cpus.push_back(i);
+	return cpus;
+}
+
+//Returns the number of CPUs that the CPU quota of the cgroup of the process allows (rounded 
+//  up), or 0 if there is no quota. Both cgroup v2 (cpu.max) and v1 (cpu.cfs_quota_us) are read.
+int cgroup_cpu_limit()
+{
+	string quota;
+	long period=0;
+	ifstream file("/sys/fs/cgroup/cpu.max");
+	if(file>>quota>>period){
+		if(quota=="max" || period<=0)
+			return 0;
+		return (stol(quota)+period-1)/period;
+	}
+	long quota_us=-1;
+	ifstream quota_file("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+	ifstream period_file("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+	if(quota_file>>quota_us && period_file>>period && quota_us>0 && period>0)
+		return (quota_us+period-1)/period;
+	return 0;
+}
+
+//Returns the number of CPUs the process can use: the size of the affinity mask, limited by 
+//  the CPU quota of the cgroup.
+int available_num_threads()
+{
+	int n=allowed_cpus().size();
+	int limit=cgroup_cpu_limit();
+	if(limit>0 && limit<n)
+		n=limit;
+	return n;
+}
 
 thread_data *read_file_init_thread_data()
 {
   thread_data *data;
 	ifstream file;
 	file.open(".//poly_finder_instructions.txt");
-	file>>weight;
+	//The first line holds one or more target weights.
+	string line;
+	getline(file,line);
+	istringstream weight_line(line);
+	weights=new int[65];
+	num_weights=0;
+	while(num_weights<65 && weight_line>>weights[num_weights])
+		num_weights++;
+	weight=weights[0];
 	file>>num_bases;
 	file>>NUM_THREADS;
 	file>>trigger_wait;
 	file>>trigger_random_jumps;
 	file>>MAX_NUM_POLYS;
+	vector<int> cpus=allowed_cpus();
+	int num_cpus=available_num_threads();
+	if(NUM_THREADS<=0)
+		NUM_THREADS=num_cpus;
+	else if(NUM_THREADS>num_cpus)
+		cout<<"(warning: "<<NUM_THREADS<<" threads on "<<num_cpus<<" available CPUs) ";
 	data=new thread_data[NUM_THREADS];
-  Polynomial *Base1 = new Polynomial[num_bases];
-  Polynomial *Base2 = new Polynomial[num_bases];
+  Polynomial *Base1 = all_Base1 = new Polynomial[num_bases];
+  Polynomial *Base2 = all_Base2 = new Polynomial[num_bases];
 	int bn;
 	unsigned int n;
 	for(int i=0;i<num_bases;i++){
@@ -370,14 +1534,41 @@ thread_data *read_file_init_thread_data()
 	}
 	file.close();
 
+  //The base pairs that have to be enumerated. With the cache, the base pairs that are already 
+  //  processed for all the target weights are skipped.
+  int *todo = new int[num_bases];
+  int num_todo=0;
+  for(int i=0;i<num_bases;i++){
+    if((long)i*num_shards/num_bases!=shard_index)
+      continue;
+    bool cached=(cache_file!=NULL);
+    for(int k=0;k<num_weights && cached;k++)
+      if(cache.find_pair(weights[k],Base1[i],Base2[i])==-1)
+        cached=false;
+    if(!cached){
+      todo[num_todo]=i;
+      num_todo++;
+    }
+  }
+  if(cache_file)
+    cout<<num_bases-num_todo<<" base pairs found in the cache...";
+  if(shard_file)
+    cout<<num_todo<<" base pairs in shard "<<shard_index<<" of "<<num_shards<<"...";
+
   int c;
   for(int i=0;i<NUM_THREADS;i++){
     data[i].num_bases=0;
-    data[i].weight=weight;
-    data[i].poly_list = new Polynomial[MAX_NUM_POLYS];
+    data[i].pair_num_polys=NULL;
+    data[i].poly_list = new Polynomial*[num_weights];
+    data[i].num_polys = new int[num_weights];
+    for(int k=0;k<num_weights;k++)
+      data[i].num_polys[k] = 0;
+    data[i].cpu = cpus[i%cpus.size()];
+    data[i].pairs_done=0;
+    data[i].leaves_done=0;
   }
   c=0;
-  for(int i=0;i<num_bases;i++){
+  for(int i=0;i<num_todo;i++){
     data[c].num_bases++;
     c++;
     c%=NUM_THREADS;
@@ -385,29 +1576,310 @@ thread_data *read_file_init_thread_data()
   for(int i=0;i<NUM_THREADS;i++){
     data[i].Base1=new Polynomial[data[i].num_bases];
     data[i].Base2=new Polynomial[data[i].num_bases];
+    if(cache_file){
+      data[i].pair_num_polys=new int*[data[i].num_bases];
+      for(int j=0;j<data[i].num_bases;j++)
+        data[i].pair_num_polys[j]=new int[num_weights];
+    }
   }
 
   c=0;
   for(int i=0;i<NUM_THREADS;i++)
     for(int j=0;j<data[i].num_bases;j++){
-      data[i].Base1[j]=Base1[c];
-      data[i].Base2[j]=Base2[c];
+      data[i].Base1[j]=Base1[todo[c]];
+      data[i].Base2[j]=Base2[todo[c]];
       c++;
     }
+  delete[] todo;
 	return data;
 }
 
 
-int main()
+////////////////////////////////////////////////////////////////////////////////
+//                 SHARDS FOR RUNNING THE CODE IN SEVERAL PROCESSES           //
+//      EACH PROCESS WRITES ITS POLYNOMIAL LISTS INTO A SHARD FILE, AND THE   //
+//         SHARD FILES ARE MERGED AND SIMPLIFIED BY THE -merge OPTION.        //
+////////////////////////////////////////////////////////////////////////////////
+
+//The shard file is a plain text file with the following format:
+//  POLY_FINDER_SHARD
+//  shard index, number of shards, number of base pairs, the hash of the target weights and 
+//    base pairs of the instruction file (see instructions_hash), and 1 if the time limit cut 
+//    the shard (its polynomials are provisional) or 0
+//  number of target weights
+//  for each target weight: the weight, the number of polynomials, and one line per 
+//    polynomial: the number of terms and the terms in the uchar format.
+
+//Returns a hash of the target weights and of the base pairs of the instruction file. The order of
+//  the terms of the bases does not matter. The shards of the same run have the same hash.
+ulong instructions_hash()
 {
+	ulong h=0xcbf29ce484222325UL;
+	vector<ulong> values;
+	for(int k=0;k<num_weights;k++)
+		values.push_back(weights[k]);
+	for(int i=0;i<num_bases;i++)
+		for(int b=0;b<2;b++){
+			Polynomial &Base=b?all_Base2[i]:all_Base1[i];
+			vector<uchar> key(Base.poly,Base.poly+Base.num_terms);
+			std::sort(key.begin(),key.end());
+			values.push_back(256+key.size());
+			values.insert(values.end(),key.begin(),key.end());
+		}
+	for(size_t i=0;i<values.size();i++){
+		h^=values[i];
+		h*=0x100000001b3UL;
+	}
+	return h;
+}
+
+//Writes the polynomial lists of all threads (after thread_function) into file_name.
+void write_shard(const char *file_name, thread_data *data)
+{
+	ofstream file;
+	file.open(file_name);
+	file<<"POLY_FINDER_SHARD\n";
+	file<<shard_index<<" "<<num_shards<<" "<<num_bases<<" "<<instructions_hash()<<" "<<(out_of_time?1:0)<<"\n";
+	file<<num_weights<<"\n";
+	for(int k=0;k<num_weights;k++){
+		int n=0;
+		for(int i=0;i<NUM_THREADS;i++)
+			n+=data[i].num_polys[k];
+		file<<weights[k]<<" "<<n<<"\n";
+		for(int i=0;i<NUM_THREADS;i++)
+			for(int j=0;j<data[i].num_polys[k];j++){
+				Polynomial &poly=data[i].poly_list[k][j];
+				file<<poly.num_terms;
+				for(int l=0;l<poly.num_terms;l++)
+					file<<" "<<(unsigned int)poly.poly[l];
+				file<<"\n";
+			}
+	}
+	file.close();
+	if(file.fail()){
+		printf("Error:unable to write the shard file %s\n",file_name);
+		exit(-1);
+	}
+}
+
+//Prints whether the representatives left by the last simplify_poly_list are proven to be in 
+//  different classes (see classes_distinct). That no class is missing is not proven: it follows 
+//  from the complete enumeration of the leaves, as always.
+void print_classes_distinct()
+{
+	if(classes_distinct)
+		cout<< "The representatives have different fingerprints, so no two of them are in the same class." << endl;
+	else
+		cout<< "Some representatives share a fingerprint; they are not proven to be in different classes." << endl;
+}
+
+//Prints the list of representatives. If the time limit cut the search (or, with -merge, one of 
+//  the shards), the list is marked as provisional: it may miss some classes and contain 
+//  equivalent polynomials.
+void print_poly_list(Polynomial *final_poly_list,int final_num_polys)
+{
+	if(out_of_time && time_limit>0)
+		cout<< "PROVISIONAL: the time limit of "<< time_limit <<" seconds was reached before the search finished."<<endl;
+	else if(out_of_time)
+		cout<< "PROVISIONAL: the time limit was reached in at least one of the merged shards."<<endl;
+	cout<< "Number of polynomial representatives: " << final_num_polys<<endl;
+	cout<< "List of representatives: "<<endl;
+	cout<<"[";
+	for(int i=0;i<final_num_polys;i++){
+		if(i)
+			cout<<",\n";
+    final_poly_list[i].print();
+  }
+	cout<<"]";
+}
+
+//Reads the shard files, combines the polynomials of each target weight, and does the final 
+//  simplification (simplify_poly_list) and printing as in the main function. The shard files 
+//  must be all the shards of the same run (same instruction file and number of shards), each 
+//  of them exactly once. If the time limit cut any of the shards, out_of_time is set, so the 
+//  result is printed as provisional.
+void merge_shards(int num_files, char **file_names)
+{
+	vector<int> merge_weights;
+	vector< vector<Polynomial> > merge_lists;
+	Polynomial poly;
+	int first_num_shards=0,first_num_bases=0;
+	ulong first_hash=0;
+	vector<bool> shard_seen;
+	for(int f=0;f<num_files;f++){
+		ifstream file;
+		file.open(file_names[f]);
+		string header;
+		file>>header;
+		if(header!="POLY_FINDER_SHARD"){
+			printf("Error:%s is not a shard file\n",file_names[f]);
+			exit(-1);
+		}
+		int nw,w,n,nt,index,shards,bases,provisional;
+		unsigned int t;
+		ulong hash;
+		file>>index>>shards>>bases>>hash>>provisional;
+		if(provisional)
+			out_of_time=true;
+		if(f==0){
+			first_num_shards=shards;
+			first_num_bases=bases;
+			first_hash=hash;
+			shard_seen.assign(max(shards,0),false);
+		}
+		if(file.fail() || shards!=first_num_shards || bases!=first_num_bases || hash!=first_hash){
+			printf("Error:%s is not a shard of the same run as %s\n",file_names[f],file_names[0]);
+			exit(-1);
+		}
+		if(index<0 || index>=shards || shard_seen[index]){
+			printf("Error:%s repeats shard %d of %d\n",file_names[f],index,shards);
+			exit(-1);
+		}
+		shard_seen[index]=true;
+		file>>nw;
+		for(int k=0;k<nw;k++){
+			file>>w>>n;
+			size_t indx=std::find(merge_weights.begin(),merge_weights.end(),w)-merge_weights.begin();
+			if(indx==merge_weights.size()){
+				merge_weights.push_back(w);
+				merge_lists.push_back(vector<Polynomial>());
+			}
+			for(int j=0;j<n;j++){
+				poly.clear();
+				file>>nt;
+				for(int l=0;l<nt;l++){
+					file>>t;
+					poly.add_term((uchar)t);
+				}
+				merge_lists[indx].push_back(poly);
+			}
+		}
+		if(file.fail()){
+			printf("Error:unable to read the shard file %s\n",file_names[f]);
+			exit(-1);
+		}
+		file.close();
+	}
+	if(num_files!=first_num_shards){
+		printf("Error:%d of %d shard files given, all the shards are needed\n",num_files,first_num_shards);
+		exit(-1);
+	}
+	cout<<"Merging "<<num_files<<" shard files."<<endl;
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for(size_t k=0;k<merge_weights.size();k++){
+		if(merge_weights.size()>1)
+			cout<< "\nWeight: "<< merge_weights[k] << endl;
+		cout<< "Simplifying polynomials, removing equivalent polynomials ... ";
+		int final_num_polys=merge_lists[k].size();
+		Polynomial *final_poly_list=new Polynomial[final_num_polys];
+		for(int i=0;i<final_num_polys;i++)
+			final_poly_list[i]=merge_lists[k][i];
+		simplify_poly_list(final_poly_list,final_num_polys);
+		cout<<"Done!"<<endl;
+		duration<double> time_span = duration_cast<microseconds>(high_resolution_clock::now() - start);
+	  cout<< "Total time elapsed: "<< time_span.count() << " seconds" << endl;	
+		print_search_statistics();
+		print_classes_distinct();
+		print_poly_list(final_poly_list,final_num_polys);
+		delete[] final_poly_list;
+	}
+}
+
+//Command line options:
+//  -cache file_name: keeps the processed base pairs and representatives in file_name, and
+//                    reuses them in the next runs. See poly_cache.h.
+//  -shard i n file_name: only enumerates the i-th (i=0,...,n-1) slice of the base pairs and writes
+//                    the polynomial lists into file_name instead of simplifying them. 
+//  -external directory: the polynomial lists that reach MAX_NUM_POLYS polynomials are written 
+//                    as run files into the (existing) directory instead of aborting, and are 
+//                    merged and simplified from there. See the EXTERNAL MEMORY MODE section.
+//  -stable_rounds n: simplify_poly_list stops after n rounds without a change in the number of 
+//                    polynomials (default 100). Larger values take longer but are safer.
+//  -search greedy|annealing|tabu: the local search strategy of quick_simplify (default greedy).
+//                    See local_search.h. The number of evaluated moves and the terms reached 
+//                    per run are printed at the end; annealing and tabu are followed by a 
+//                    greedy pass whose moves are printed apart.
+//  -time_limit seconds: stops the search after the given number of seconds and prints the 
+//                    current representatives, marked as provisional. With -cache, the cache is 
+//                    not saved then.
+//  -progress seconds: the interval of the progress reports (default 60, 0 turns them off).
+//  -merge file_name1 file_name2 ...: merges the shard files and prints the representatives.
+//                    The files must be all the n shards of the same run. The instruction file 
+//                    is not read. Must be the last option.
+//For example, running "./a.out -shard 0 2 s0.txt & ./a.out -shard 1 2 s1.txt; wait" and then 
+//  "./a.out -merge s0.txt s1.txt" gives the same representatives as "./a.out".
+int main(int argc, char **argv)
+{
+	for(int i=1;i<argc;i++){
+		if(!strcmp(argv[i],"-cache") && i+1<argc)
+			cache_file=argv[++i];
+		else if(!strcmp(argv[i],"-shard") && i+3<argc){
+			shard_index=atoi(argv[++i]);
+			num_shards=atoi(argv[++i]);
+			shard_file=argv[++i];
+			if(num_shards<1 || shard_index<0 || shard_index>=num_shards){
+				printf("Error:invalid shard %d of %d\n",shard_index,num_shards);
+				exit(-1);
+			}
+		}
+		else if(!strcmp(argv[i],"-external") && i+1<argc)
+			external_dir=argv[++i];
+		else if(!strcmp(argv[i],"-stable_rounds") && i+1<argc)
+			stable_rounds=atoi(argv[++i]);
+		else if(!strcmp(argv[i],"-time_limit") && i+1<argc)
+			time_limit=atof(argv[++i]);
+		else if(!strcmp(argv[i],"-progress") && i+1<argc)
+			progress_interval=atoi(argv[++i]);
+		else if(!strcmp(argv[i],"-search") && i+1<argc){
+			i++;
+			if(!strcmp(argv[i],"greedy"))
+				Polynomial::strategy=greedy_search;
+			else if(!strcmp(argv[i],"annealing"))
+				Polynomial::strategy=annealing_search;
+			else if(!strcmp(argv[i],"tabu"))
+				Polynomial::strategy=tabu_search;
+			else{
+				printf("Error:unknown search strategy %s\n",argv[i]);
+				exit(-1);
+			}
+		}
+		else if(!strcmp(argv[i],"-merge") && i+1<argc){
+			init();
+			vector<int> cpus=allowed_cpus();
+			cpus.resize(min((int)cpus.size(),available_num_threads()));
+			if(!cpus.empty())
+				cpus.erase(cpus.begin());
+			start_dedup_pool(cpus);
+			merge_shards(argc-i-1,argv+i+1);
+			return 0;
+		}
+		else{
+			printf("Error:unknown option %s\n",argv[i]);
+			exit(-1);
+		}
+	}
+	if((cache_file!=NULL)+(shard_file!=NULL)+(external_dir!=NULL)>1){
+		printf("Error:only one of -cache, -shard and -external can be used\n");
+		exit(-1);
+	}
 	init();
+	init_code_bits();
+	if(cache_file)
+		cache.load(cache_file);
 	cout<<"Reading the instruction file and polynomials...";
   thread_data *data = read_file_init_thread_data();
+  //In the external memory mode, the lists are larger than MAX_NUM_POLYS by design, so the shared 
+  //  set gets a fixed size (about 24MB) instead. It fills up in long runs; then it stops taking 
+  //  new polynomials (see PolySet), and the repeated polynomials on the disk are removed by the 
+  //  merge of the runs (see merge_run_group).
+  if(!cache_file)
+    shared_set.init(max((long)MAX_NUM_POLYS*num_weights,external_dir?(1L<<18):0L));
+  run_files=new vector<string>[num_weights];
+  total_matching=new atomic<long>[num_weights];
+  total_orbits=new atomic<long>[num_weights];
+  for(int k=0;k<num_weights;k++)
+    total_matching[k]=total_orbits[k]=0;
   cout<<"Done!"<<endl;
-  Polynomial **poly_list = new Polynomial*[NUM_THREADS];
-  for(int i = 0; i < NUM_THREADS; ++i)
-    poly_list[i] = new Polynomial[MAX_NUM_POLYS];
-  int *num_polys=new int[NUM_THREADS];
 	
 	pthread_t threads[NUM_THREADS];
   pthread_attr_t attr;
@@ -417,12 +1889,19 @@ int main()
   pthread_attr_init(&attr);
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
 
-	cout<<"Finding all polynomials with weight "<<weight<<" ... "<<endl;
+	cout<<"Finding all polynomials with weight";
+	for(int k=0;k<num_weights;k++)
+		cout<<" "<<weights[k];
+	cout<<" ... "<<endl;
 	cout<<"Starting timer!"<<endl;
 	high_resolution_clock::time_point start = high_resolution_clock::now();
 	int rc;
+  cpu_set_t cpu_set;
   for(int i = 0; i < NUM_THREADS; i++ ) {
-     printf("Creating thread %d \n",i);
+     printf("Creating thread %d on CPU %d \n",i,data[i].cpu);
+     CPU_ZERO(&cpu_set);
+     CPU_SET(data[i].cpu,&cpu_set);
+     pthread_attr_setaffinity_np(&attr,sizeof(cpu_set),&cpu_set);
      rc = pthread_create(&threads[i], &attr, thread_function, (void *)&data[i]);
      if (rc) {
         printf("Error:unable to create thread.");
@@ -430,6 +1909,11 @@ int main()
      }
   }
   pthread_attr_destroy(&attr);
+  pthread_t progress_thread;
+  if(progress_interval>0 && pthread_create(&progress_thread, NULL, progress_function, (void *)data)){
+    printf("Error:unable to create thread.");
+    exit(-1);
+  }
   for(int i = 0; i < NUM_THREADS; i++ ) {
     rc = pthread_join(threads[i], &status);
     if (rc) {
@@ -437,38 +1921,72 @@ int main()
       exit(-1);
     }
   }
+  enumeration_done=true;
+  if(progress_interval>0)
+    pthread_join(progress_thread, &status);
+	//The CPUs of the worker threads (but the first one, for the main thread) are now free for the 
+	//  helpers of remove_equivalent_polys.
+	vector<int> helper_cpus;
+	for(int i=1;i<min(NUM_THREADS,available_num_threads());i++)
+		helper_cpus.push_back(data[i].cpu);
+	start_dedup_pool(helper_cpus);
 	cout<<"All threads done. All polynomials found."<<endl;
 	int tot_num=0;
 	for(int i=0;i<NUM_THREADS;i++)
-		tot_num+=data[i].num_polys;
+		for(int k=0;k<num_weights;k++)
+			tot_num+=data[i].num_polys[k];
+	if(external_dir)
+		tot_num=num_spilled;
 	cout<<"Total number of polynomials after one level of pruning: "<<tot_num<<endl;
+	if(!cache_file)
+		cout<<"Repeated polynomials rejected by the shared set: "<<shared_set.num_rejected<<endl;
+	print_leaf_orbits();
 
   high_resolution_clock::time_point stop = high_resolution_clock::now();
   duration<double> duration = duration_cast<microseconds>(stop - start);
 	cout<< "Time: "<< duration.count() << " seconds" << endl;
-	cout<< "Simplifying polynomials, removing equivalent polynomials ... ";
-	int final_num_polys=0;
-	for(int i=0;i<NUM_THREADS;i++)
-		final_num_polys+=data[i].num_polys;
-	Polynomial *final_poly_list=new Polynomial[final_num_polys];
+	if(shard_file){
+		if(out_of_time)
+			cout<< "PROVISIONAL: the time limit was reached, the shard is not completely enumerated."<<endl;
+		write_shard(shard_file,data);
+		cout<< "Polynomial lists are written into "<< shard_file << endl;
+		return 0;
+	}
+	for(int k=0;k<num_weights;k++){
+		if(num_weights>1)
+			cout<< "\nWeight: "<< weights[k] << endl;
+		cout<< "Simplifying polynomials, removing equivalent polynomials ... ";
+		int final_num_polys=0;
+		Polynomial *final_poly_list;
+		if(cache_file)
+			mix_poly_lists_with_cache(final_poly_list,final_num_polys,data,k);
+		else if(external_dir)
+			external_mix_poly_lists(final_poly_list,final_num_polys,k);
+		else{
+			for(int i=0;i<NUM_THREADS;i++)
+				final_num_polys+=data[i].num_polys[k];
+			final_poly_list=new Polynomial[final_num_polys];
 		
-	mix_poly_lists(final_poly_list,final_num_polys,data);
+			mix_poly_lists(final_poly_list,final_num_polys,data,k);
+		}
 
-	cout<<"Done!"<<endl;
+		cout<<"Done!"<<endl;
 
-	stop = high_resolution_clock::now();
-	duration = duration_cast<microseconds>(stop - start);
+		stop = high_resolution_clock::now();
+		duration = duration_cast<microseconds>(stop - start);
   
-  cout<< "Total time elapsed: "<< duration.count() << " seconds" << endl;	
-	cout<< "Number of polynomial representatives: " << final_num_polys<<endl;
-	cout<< "List of representatives: "<<endl;
-	cout<<"[";
-	for(int i=0;i<final_num_polys;i++){
-		if(i)
-			cout<<",\n";
-    final_poly_list[i].print();
-  }
-	cout<<"]";
+	  cout<< "Total time elapsed: "<< duration.count() << " seconds" << endl;	
+		print_search_statistics();
+		//With the cache, the cached representatives are not part of the last simplify_poly_list.
+		if(!cache_file)
+			print_classes_distinct();
+		print_poly_list(final_poly_list,final_num_polys);
+		delete[] final_poly_list;
+	}
+	if(cache_file && out_of_time)
+		cout<< "\nThe cache is not saved, since the results are provisional."<<endl;
+	else if(cache_file)
+		cache.save(cache_file);
 	return 0;
 }
 
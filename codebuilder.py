@@ -227,17 +227,22 @@ def CPP_Representation(poly):
 
 #base_pairs is an array of all base pairs, where the input is in the in terms
 # of ring variables y1,..., y6.
-#weight is the target weight.
-#number_of_threads is the number of cpu threads used.
+#weight is the target weight, or a list of target weights that are all found in
+# a single run of the C++ code.
+#number_of_threads is the number of cpu threads used. With number_of_threads=0,
+# the C++ code uses all the cpus available to it.
 #trigger_wait & trigger_random_jumps & max_number_polys -> see the C++ code 
 # for detailed and explanation. It is ususally fine to use the default values.
 
 
-def write_instuctions(base_pairs,weight,number_of_threads=_sage_const_8 , trigger_wait=_sage_const_1 ,
+def write_instuctions(base_pairs,weight,number_of_threads=_sage_const_0 , trigger_wait=_sage_const_1 ,
                               trigger_random_jumps=_sage_const_0 , max_number_polys=_sage_const_10000 ):
     file = open("poly_finder_instructions.txt", "w")
     num_bases = len(base_pairs)
-    file.write(str(weight)+"\n");
+    if isinstance(weight, (list, tuple)):
+        file.write(" ".join(str(w) for w in weight)+"\n");
+    else:
+        file.write(str(weight)+"\n");
     file.write(str(num_bases)+"\n");
     file.write(str(number_of_threads)+"\n");
     file.write(str(trigger_wait)+"\n");
@@ -0,0 +1,201 @@
+////////////////////////////////////////////////////////////////////////////////
+//                            LOCAL SEARCH LIBRARY                            //
+//       DEFINES THE STRATEGIES USED BY quick_simplify IN THE POLYNOMIAL      //
+//            CLASS TO MINIMIZE THE NUMBER OF TERMS OF A POLYNOMIAL.          //
+////////////////////////////////////////////////////////////////////////////////
+
+//All strategies use the same moves (the 8 plus_ones and the 56 transpositions, see
+//  make_move in the Polynomial class) and the same controls:
+//  wait: the strategy stops after wait consecutive rounds without finding a
+//    polynomial with fewer terms than the best one found so far.
+//  random_jumps: how far the strategy may move away from a local minimum.
+//At the end, the polynomial is replaced by the best polynomial found. The annealing
+//  and tabu strategies finish with greedy_descent on it, so that their result is
+//  always a local minimum, as the result of greedy_search.
+//Every strategy adds the number of moves it evaluated to move_evaluations, and the
+//  number of terms it reached to strategy_terms (see record_strategy), so that the
+//  strategies can be compared on the same input by the terms they reach per
+//  evaluated move (see print_search_statistics).
+//The local minima of annealing and tabu are often different for equivalent
+//  polynomials, so == cannot merge them, and too many classes are found. Therefore
+//  quick_simplify_list runs canonicalize after them, a greedy_search pass whose 
+//  moves are counted apart, in canonical_evaluations.
+
+atomic<long> move_evaluations(0);
+atomic<long> strategy_runs(0),strategy_terms(0);
+atomic<long> canonical_evaluations(0);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Records one run of a strategy that evaluated evaluations moves and left p.
+void record_strategy(Polynomial &p,long evaluations)
+{
+	move_evaluations.fetch_add(evaluations,memory_order_relaxed);
+	strategy_runs.fetch_add(1,memory_order_relaxed);
+	strategy_terms.fetch_add(p.num_terms,memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//  Greedily accepts plus_ones and transpositions that decrease the number of
+//  terms until none does. Returns the number of evaluated moves.
+long greedy_descent(Polynomial &p)
+{
+	long evaluations=0;
+	bool improved=true;
+	while(improved){
+		improved=p.plus_ones();
+		evaluations+=8;
+		if(!improved){
+			improved=p.transpositions();
+			evaluations+=56;
+		}
+	}
+	return evaluations;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//  The rounds of greedy_search below. Returns the number of evaluated moves.
+long greedy_rounds(Polynomial &p,int wait,int random_jumps)
+{
+	Polynomial best;
+	int min_terms=255;
+	int steps=0;
+	int a,b;
+	long evaluations=0;
+	best=p;
+	while(steps<wait){
+		steps++;
+		for(int i=0;i<random_jumps;i++){
+			a=rand()%8;
+			b=rand()%8;
+			if(a!=b)
+				p.make_move(a,b);
+		}
+		evaluations+=greedy_descent(p);
+		if(p.num_terms<min_terms){
+			min_terms=p.num_terms;
+			steps=0;
+			best=p;
+		}
+	}
+	p=best;
+	return evaluations;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//  The original strategy. Each round performs random_jumps random transpositions
+//  and then greedily accepts plus_ones and transpositions that decrease the
+//  number of terms until none does.
+void greedy_search(Polynomial &p,int wait,int random_jumps)
+{
+	long evaluations=greedy_rounds(p,wait,random_jumps);
+	record_strategy(p,evaluations);
+	return ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//  Simulated annealing. Each round proposes 64 random moves. A move that does
+//  not increase the number of terms is always accepted, and a move that adds d
+//  terms is accepted with probability exp(-d/T). The temperature T starts at
+//  0.5+random_jumps/4 and is multiplied by 0.9 after every round.
+void annealing_search(Polynomial &p,int wait,int random_jumps)
+{
+	Polynomial best;
+	int steps=0;
+	int a,b,d;
+	long evaluations=0;
+	double T=0.5+random_jumps/4.0;
+	best=p;
+	while(steps<wait){
+		steps++;
+		for(int i=0;i<64;i++){
+			a=rand()%8;
+			b=rand()%8;
+			d=p.move_num_terms(a,b)-p.num_terms;
+			evaluations++;
+			if(d<=0 || rand()<RAND_MAX*exp(-d/T)){
+				p.make_move(a,b);
+				if(p.num_terms<best.num_terms){
+					best=p;
+					steps=0;
+				}
+			}
+		}
+		T*=0.9;
+	}
+	p=best;
+	evaluations+=greedy_descent(p);
+	record_strategy(p,evaluations);
+	return ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//  Tabu search. Each round evaluates all 64 moves and performs the best move
+//  that is not tabu, even if it increases the number of terms. A performed move
+//  stays tabu for the next 3+random_jumps rounds (every move is its own inverse,
+//  so this prevents undoing it), unless it gives a new best polynomial.
+void tabu_search(Polynomial &p,int wait,int random_jumps)
+{
+	Polynomial best;
+	int steps=0,round=0;
+	int tabu[8][8];
+	long evaluations=0;
+	best=p;
+	for(int a=0;a<8;a++)
+		for(int b=0;b<8;b++)
+			tabu[a][b]=0;
+	while(steps<wait){
+		steps++;
+		round++;
+		int move_a=-1,move_b=-1,move_terms=256,n;
+		for(int a=0;a<8;a++)
+			for(int b=0;b<8;b++){
+				n=p.move_num_terms(a,b);
+				evaluations++;
+				if(n<move_terms && (tabu[a][b]<round || n<best.num_terms)){
+					move_terms=n;
+					move_a=a;
+					move_b=b;
+				}
+			}
+		if(move_a==-1)
+			continue;
+		p.make_move(move_a,move_b);
+		tabu[move_a][move_b]=round+3+random_jumps;
+		if(p.num_terms<best.num_terms){
+			best=p;
+			steps=0;
+		}
+	}
+	p=best;
+	evaluations+=greedy_descent(p);
+	record_strategy(p,evaluations);
+	return ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//  The canonicalizing pass after a strategy other than greedy_search: the rounds
+//  of greedy_search from p, counted in canonical_evaluations. It sorts p.
+void canonicalize(Polynomial &p,int wait,int random_jumps)
+{
+	if(time_is_up())
+		out_of_time=true;
+	else
+		canonical_evaluations.fetch_add(greedy_rounds(p,wait,random_jumps),memory_order_relaxed);
+	p.sort();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//  Prints the moves evaluated by the strategy and the terms it reached per run,
+//  and the moves of the canonicalizing pass, if any.
+void print_search_statistics()
+{
+	cout<< "Move evaluations: "<< move_evaluations;
+	if(strategy_runs>0)
+		cout<< " in "<< strategy_runs<< " runs of the local search ("<< (double)move_evaluations/strategy_runs
+		    << " per run), "<< (double)strategy_terms/strategy_runs<< " terms reached per run";
+	cout<< endl;
+	if(canonical_evaluations>0)
+		cout<< "Move evaluations of the canonicalizing greedy pass: "<< canonical_evaluations<< endl;
+}
+
+void (*Polynomial::strategy)(Polynomial &p,int wait,int random_jumps)=greedy_search;
@@ -0,0 +1,437 @@
+////////////////////////////////////////////////////////////////////////////////
+//                      BATCHED SIMPLIFICATION LIBRARY                        //
+//       DEFINES THE 'POLYBATCH' CLASS THAT SIMPLIFIES SEVERAL POLYNOMIALS    //
+//        AT ONCE WITH THE SAME MOVES, USING AVX-512 OR AVX2 IF AVAILABLE.    //
+////////////////////////////////////////////////////////////////////////////////
+
+//A batch holds up to SIZE polynomials as term bitmaps (see term_bitmap in the
+//  Polynomial class) in a structure-of-arrays layout: bits[w][j] is the word w of
+//  the bitmap of the polynomial in lane j. A move (source,target) is computed on
+//  the bitmaps with masks and shifts only, the same for all lanes:
+//  1. keep the terms containing x_source and remove x_source from them,
+//  2. for a transposition, add x_target to these terms.
+//  The result is the toggle of move_bitmap in the Polynomial class, so the change
+//  of the number of terms is counted in the same way (see move_delta). One
+//  AVX-512 instruction works on all 8 lanes, one AVX2 instruction on 4 lanes. The
+//  kernel is chosen at run time from the CPU, and the plain C++ kernel is used on
+//  CPUs without AVX2.
+//Each lane follows exactly the steps of greedy_search in local_search.h on its
+//  own polynomial. The lanes that are done are masked out.
+
+class PolyBatch
+{
+	public:
+		static const int SIZE=8;
+
+////////////////////////////////////////////////////////////////////////////////
+//  Loads the polynomials *polys[0],...,*polys[n-1] (n<=SIZE) into the lanes.
+		void load(Polynomial **polys,int n);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Writes the lanes back into *polys[0],...,*polys[n-1] and sorts them, as at
+//  the end of quick_simplify.
+		void store(Polynomial **polys);
+
+////////////////////////////////////////////////////////////////////////////////
+//  The same as greedy_search (the default strategy of quick_simplify) on the
+//  polynomial of every lane.
+		void greedy_search(int wait,int random_jumps);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Returns the name of the kernel chosen for this CPU.
+		static const char *kernel_name();
+	private:
+		alignas(64) ulong bits[4][SIZE];
+		alignas(64) long num_terms[SIZE];
+		int size;
+//  Tries the move (source,target) in every lane of the bit mask lanes and
+//  performs it in those lanes where it decreases the number of terms. Returns
+//  the bit mask of the lanes where it is performed.
+		static int (*kernel)(PolyBatch &b,int source,int target,int lanes);
+		static int scalar_kernel(PolyBatch &b,int source,int target,int lanes);
+		static int avx2_kernel(PolyBatch &b,int source,int target,int lanes);
+		static int avx512_kernel(PolyBatch &b,int source,int target,int lanes);
+		static int (*select_kernel())(PolyBatch &b,int source,int target,int lanes);
+//  Performs the move (source,target) in one lane, whatever the number of terms.
+		void make_move(int lane,int source,int target);
+//  The plus_ones and transpositions of the Polynomial class on the lanes in
+//  the bit mask lanes. Return the bit mask of the lanes that changed.
+		int plus_ones(int lanes);
+		int transpositions(int lanes);
+//  greedy_descent of local_search.h on the lanes in the bit mask lanes.
+//  Returns the number of evaluated moves.
+		long greedy_descent(int lanes);
+};
+
+//For s<6, the bit number x of SOURCE_MASK[s] is set if the term x contains
+//  the variable s.
+const ulong SOURCE_MASK[6]={0xaaaaaaaaaaaaaaaaUL,0xccccccccccccccccUL,0xf0f0f0f0f0f0f0f0UL,
+                            0xff00ff00ff00ff00UL,0xffff0000ffff0000UL,0xffffffff00000000UL};
+
+//Computes the toggle of the move (source,target) from the words of a bitmap.
+//  The variables 6 and 7 select the word, so for them the words are moved
+//  instead of the bits.
+inline void batch_toggle(const ulong x[4],int source,int target,ulong toggle[4])
+{
+	ulong y[4];
+	if(source<6)
+		for(int w=0;w<4;w++)
+			y[w]=(x[w]&SOURCE_MASK[source])>>(1<<source);
+	else if(source==6){
+		y[0]=x[1];  y[1]=0;  y[2]=x[3];  y[3]=0;
+	}
+	else{
+		y[0]=x[2];  y[1]=x[3];  y[2]=0;  y[3]=0;
+	}
+	if(source==target)
+		for(int w=0;w<4;w++)
+			toggle[w]=y[w];
+	else if(target<6)
+		for(int w=0;w<4;w++)
+			toggle[w]=(y[w]&SOURCE_MASK[target])^((y[w]&~SOURCE_MASK[target])<<(1<<target));
+	else if(target==6){
+		toggle[0]=0;  toggle[1]=y[0]^y[1];  toggle[2]=0;  toggle[3]=y[2]^y[3];
+	}
+	else{
+		toggle[0]=0;  toggle[1]=0;  toggle[2]=y[0]^y[2];  toggle[3]=y[1]^y[3];
+	}
+	toggle[0]&=~((ulong)1);
+}
+
+
+
+
+void PolyBatch::load(Polynomial **polys,int n)
+{
+	ulong x[4];
+	size=n;
+	for(int j=0;j<SIZE;j++){
+		x[0]=x[1]=x[2]=x[3]=0;
+		num_terms[j]=0;
+		if(j<n){
+			polys[j]->term_bitmap(x);
+			num_terms[j]=polys[j]->num_terms;
+		}
+		for(int w=0;w<4;w++)
+			bits[w][j]=x[w];
+	}
+}
+
+
+
+
+void PolyBatch::store(Polynomial **polys)
+{
+	ulong x[4];
+	for(int j=0;j<size;j++){
+		for(int w=0;w<4;w++)
+			x[w]=bits[w][j];
+		polys[j]->set_terms(x);
+		polys[j]->sort();
+	}
+}
+
+
+
+
+void PolyBatch::make_move(int lane,int source,int target)
+{
+	ulong x[4],toggle[4];
+	for(int w=0;w<4;w++)
+		x[w]=bits[w][lane];
+	batch_toggle(x,source,target,toggle);
+	for(int w=0;w<4;w++){
+		num_terms[lane]+=__builtin_popcountl(toggle[w]&~x[w])-__builtin_popcountl(toggle[w]&x[w]);
+		bits[w][lane]=x[w]^toggle[w];
+	}
+}
+
+
+
+
+int PolyBatch::scalar_kernel(PolyBatch &b,int source,int target,int lanes)
+{
+	int improved=0;
+	ulong x[4],toggle[4];
+	for(int j=0;j<SIZE;j++)
+		if(lanes&(1<<j)){
+			for(int w=0;w<4;w++)
+				x[w]=b.bits[w][j];
+			batch_toggle(x,source,target,toggle);
+			int delta=0;
+			for(int w=0;w<4;w++)
+				delta+=__builtin_popcountl(toggle[w]&~x[w])-__builtin_popcountl(toggle[w]&x[w]);
+			if(delta<0){
+				for(int w=0;w<4;w++)
+					b.bits[w][j]=x[w]^toggle[w];
+				b.num_terms[j]+=delta;
+				improved|=1<<j;
+			}
+		}
+	return improved;
+}
+
+
+
+
+//The number of set bits of each byte of v, from a table of the 16 nibbles.
+__attribute__((target("avx2")))
+inline __m256i popcount_bytes_avx2(__m256i v)
+{
+	const __m256i table=_mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+	                                     0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+	const __m256i low=_mm256_set1_epi8(0x0f);
+	return _mm256_add_epi8(_mm256_shuffle_epi8(table,_mm256_and_si256(v,low)),
+	                       _mm256_shuffle_epi8(table,_mm256_and_si256(_mm256_srli_epi16(v,4),low)));
+}
+
+__attribute__((target("avx2")))
+int PolyBatch::avx2_kernel(PolyBatch &b,int source,int target,int lanes)
+{
+	const __m256i zero=_mm256_setzero_si256();
+	int improved=0;
+	for(int h=0;h<SIZE;h+=4){
+		if(!((lanes>>h)&15))
+			continue;
+		__m256i x[4],y[4],t[4];
+		for(int w=0;w<4;w++)
+			x[w]=_mm256_load_si256((__m256i *)&b.bits[w][h]);
+		if(source<6){
+			__m256i m=_mm256_set1_epi64x(SOURCE_MASK[source]);
+			__m128i c=_mm_cvtsi32_si128(1<<source);
+			for(int w=0;w<4;w++)
+				y[w]=_mm256_srl_epi64(_mm256_and_si256(x[w],m),c);
+		}
+		else if(source==6){
+			y[0]=x[1];  y[1]=zero;  y[2]=x[3];  y[3]=zero;
+		}
+		else{
+			y[0]=x[2];  y[1]=x[3];  y[2]=zero;  y[3]=zero;
+		}
+		if(source==target)
+			for(int w=0;w<4;w++)
+				t[w]=y[w];
+		else if(target<6){
+			__m256i m=_mm256_set1_epi64x(SOURCE_MASK[target]);
+			__m128i c=_mm_cvtsi32_si128(1<<target);
+			for(int w=0;w<4;w++)
+				t[w]=_mm256_xor_si256(_mm256_and_si256(y[w],m),_mm256_sll_epi64(_mm256_andnot_si256(m,y[w]),c));
+		}
+		else if(target==6){
+			t[0]=zero;  t[1]=_mm256_xor_si256(y[0],y[1]);  t[2]=zero;  t[3]=_mm256_xor_si256(y[2],y[3]);
+		}
+		else{
+			t[0]=zero;  t[1]=zero;  t[2]=_mm256_xor_si256(y[0],y[2]);  t[3]=_mm256_xor_si256(y[1],y[3]);
+		}
+		t[0]=_mm256_andnot_si256(_mm256_set1_epi64x(1),t[0]);
+		//delta = (terms added) - (terms removed) = popcount(t) - 2*popcount(t&x). A byte
+		//  sums at most 4 popcounts of bytes, so it does not overflow.
+		__m256i all=zero,common=zero;
+		for(int w=0;w<4;w++){
+			all=_mm256_add_epi8(all,popcount_bytes_avx2(t[w]));
+			common=_mm256_add_epi8(common,popcount_bytes_avx2(_mm256_and_si256(t[w],x[w])));
+		}
+		all=_mm256_sad_epu8(all,zero);
+		common=_mm256_sad_epu8(common,zero);
+		__m256i delta=_mm256_sub_epi64(all,_mm256_add_epi64(common,common));
+		__m256i on=_mm256_set_epi64x(-(long)((lanes>>(h+3))&1),-(long)((lanes>>(h+2))&1),
+		                             -(long)((lanes>>(h+1))&1),-(long)((lanes>>h)&1));
+		__m256i accept=_mm256_and_si256(on,_mm256_cmpgt_epi64(zero,delta));
+		for(int w=0;w<4;w++)
+			_mm256_store_si256((__m256i *)&b.bits[w][h],_mm256_xor_si256(x[w],_mm256_and_si256(t[w],accept)));
+		__m256i n=_mm256_load_si256((__m256i *)&b.num_terms[h]);
+		_mm256_store_si256((__m256i *)&b.num_terms[h],_mm256_add_epi64(n,_mm256_and_si256(delta,accept)));
+		improved|=_mm256_movemask_pd(_mm256_castsi256_pd(accept))<<h;
+	}
+	return improved;
+}
+
+
+
+
+__attribute__((target("avx512f,avx512bw")))
+inline __m512i popcount_bytes_avx512(__m512i v)
+{
+	const __m512i table=_mm512_broadcast_i32x4(_mm_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4));
+	const __m512i low=_mm512_set1_epi8(0x0f);
+	return _mm512_add_epi8(_mm512_shuffle_epi8(table,_mm512_and_si512(v,low)),
+	                       _mm512_shuffle_epi8(table,_mm512_and_si512(_mm512_srli_epi16(v,4),low)));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+int PolyBatch::avx512_kernel(PolyBatch &b,int source,int target,int lanes)
+{
+	const __m512i zero=_mm512_setzero_si512();
+	__m512i x[4],y[4],t[4];
+	for(int w=0;w<4;w++)
+		x[w]=_mm512_load_si512(&b.bits[w][0]);
+	if(source<6){
+		__m512i m=_mm512_set1_epi64(SOURCE_MASK[source]);
+		__m128i c=_mm_cvtsi32_si128(1<<source);
+		for(int w=0;w<4;w++)
+			y[w]=_mm512_srl_epi64(_mm512_and_si512(x[w],m),c);
+	}
+	else if(source==6){
+		y[0]=x[1];  y[1]=zero;  y[2]=x[3];  y[3]=zero;
+	}
+	else{
+		y[0]=x[2];  y[1]=x[3];  y[2]=zero;  y[3]=zero;
+	}
+	if(source==target)
+		for(int w=0;w<4;w++)
+			t[w]=y[w];
+	else if(target<6){
+		__m512i m=_mm512_set1_epi64(SOURCE_MASK[target]);
+		__m128i c=_mm_cvtsi32_si128(1<<target);
+		for(int w=0;w<4;w++)
+			t[w]=_mm512_xor_si512(_mm512_and_si512(y[w],m),_mm512_sll_epi64(_mm512_andnot_si512(m,y[w]),c));
+	}
+	else if(target==6){
+		t[0]=zero;  t[1]=_mm512_xor_si512(y[0],y[1]);  t[2]=zero;  t[3]=_mm512_xor_si512(y[2],y[3]);
+	}
+	else{
+		t[0]=zero;  t[1]=zero;  t[2]=_mm512_xor_si512(y[0],y[2]);  t[3]=_mm512_xor_si512(y[1],y[3]);
+	}
+	t[0]=_mm512_andnot_si512(_mm512_set1_epi64(1),t[0]);
+	//See avx2_kernel.
+	__m512i all=zero,common=zero;
+	for(int w=0;w<4;w++){
+		all=_mm512_add_epi8(all,popcount_bytes_avx512(t[w]));
+		common=_mm512_add_epi8(common,popcount_bytes_avx512(_mm512_and_si512(t[w],x[w])));
+	}
+	all=_mm512_sad_epu8(all,zero);
+	common=_mm512_sad_epu8(common,zero);
+	__m512i delta=_mm512_sub_epi64(all,_mm512_add_epi64(common,common));
+	__mmask8 accept=_mm512_cmplt_epi64_mask(delta,zero)&(__mmask8)lanes;
+	for(int w=0;w<4;w++)
+		_mm512_store_si512(&b.bits[w][0],_mm512_mask_xor_epi64(x[w],accept,x[w],t[w]));
+	__m512i n=_mm512_load_si512(&b.num_terms[0]);
+	_mm512_store_si512(&b.num_terms[0],_mm512_mask_add_epi64(n,accept,n,delta));
+	return accept;
+}
+
+
+
+
+int (*PolyBatch::select_kernel())(PolyBatch &b,int source,int target,int lanes)
+{
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return avx512_kernel;
+	if(__builtin_cpu_supports("avx2"))
+		return avx2_kernel;
+	return scalar_kernel;
+}
+
+int (*PolyBatch::kernel)(PolyBatch &b,int source,int target,int lanes)=PolyBatch::select_kernel();
+
+
+
+
+const char *PolyBatch::kernel_name()
+{
+	if(kernel==avx512_kernel)
+		return "AVX-512";
+	if(kernel==avx2_kernel)
+		return "AVX2";
+	return "scalar";
+}
+
+
+
+
+int PolyBatch::plus_ones(int lanes)
+{
+	int changed=0;
+	for(int var=0;var<8;var++)
+		changed|=kernel(*this,var,var,lanes);
+	return changed;
+}
+
+
+
+
+int PolyBatch::transpositions(int lanes)
+{
+	int changed=0;
+	for(int var_source=0;var_source<8;var_source++)
+		for(int var_target=0;var_target<8;var_target++)
+			if(var_target!=var_source)
+				changed|=kernel(*this,var_source,var_target,lanes);
+	return changed;
+}
+
+
+
+
+long PolyBatch::greedy_descent(int lanes)
+{
+	long evaluations=0;
+	while(lanes){
+		//As in greedy_descent, a lane tries the transpositions only if no plus_one
+		//  changed it, and it is done when neither did.
+		int improved=plus_ones(lanes);
+		evaluations+=8*__builtin_popcount(lanes);
+		int rest=lanes&~improved;
+		if(rest){
+			improved|=transpositions(rest);
+			evaluations+=56*__builtin_popcount(rest);
+		}
+		lanes&=improved;
+	}
+	return evaluations;
+}
+
+
+
+
+void PolyBatch::greedy_search(int wait,int random_jumps)
+{
+	alignas(64) ulong best[4][SIZE];
+	int min_terms[SIZE],steps[SIZE];
+	int a,b;
+	long evaluations=0;
+	int lanes=(1<<size)-1;
+	for(int j=0;j<size;j++){
+		min_terms[j]=255;
+		steps[j]=0;
+		for(int w=0;w<4;w++)
+			best[w][j]=bits[w][j];
+	}
+	for(int j=0;j<size;j++)
+		if(steps[j]>=wait)
+			lanes&=~(1<<j);
+	while(lanes){
+		for(int j=0;j<size;j++)
+			if(lanes&(1<<j)){
+				steps[j]++;
+				for(int i=0;i<random_jumps;i++){
+					a=rand()%8;
+					b=rand()%8;
+					if(a!=b)
+						make_move(j,a,b);
+				}
+			}
+		evaluations+=greedy_descent(lanes);
+		for(int j=0;j<size;j++)
+			if(lanes&(1<<j)){
+				if(num_terms[j]<min_terms[j]){
+					min_terms[j]=num_terms[j];
+					steps[j]=0;
+					for(int w=0;w<4;w++)
+						best[w][j]=bits[w][j];
+				}
+				if(steps[j]>=wait)
+					lanes&=~(1<<j);
+			}
+	}
+	for(int j=0;j<size;j++){
+		for(int w=0;w<4;w++)
+			bits[w][j]=best[w][j];
+		num_terms[j]=__builtin_popcountl(best[0][j])+__builtin_popcountl(best[1][j])
+		            +__builtin_popcountl(best[2][j])+__builtin_popcountl(best[3][j]);
+		strategy_terms.fetch_add(num_terms[j],memory_order_relaxed);
+	}
+	move_evaluations.fetch_add(evaluations,memory_order_relaxed);
+	strategy_runs.fetch_add(size,memory_order_relaxed);
+}
@@ -0,0 +1,272 @@
+////////////////////////////////////////////////////////////////////////////////
+//                          POLYNOMIAL CACHE LIBRARY                          //
+//          DEFINES THE 'POLYCACHE' CLASS THAT KEEPS THE BASE PAIRS AND       //
+//        REPRESENTATIVES FOUND IN PREVIOUS RUNS IN A FILE ON THE DISK.       //
+////////////////////////////////////////////////////////////////////////////////
+
+//The cache file is a plain text file with the following format:
+//  POLY_FINDER_CACHE
+//  number of representatives
+//  one line per representative: weight, number of terms, terms
+//  number of base pairs
+//  one line per base pair: weight, number of terms of Base1, terms of Base1,
+//    number of terms of Base2, terms of Base2, number of representatives,
+//    indices of the representatives of the classes found from this base pair.
+//The terms are written as numbers in the uchar format of the Polynomial class.
+//In memory, the representatives are keyed by their weight and affine fingerprint (see walsh.h),
+//  so only the representatives with the same key are compared with ==.
+
+class PolyCache
+{
+	public:
+
+////////////////////////////////////////////////////////////////////////////////
+//  Loads the cache from file_name. A missing file gives an empty cache.
+		void load(const char *file_name);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Writes the cache into file_name. The file is first written to file_name.tmp
+//  and then renamed, so an interrupted run never leaves a broken cache behind.
+		void save(const char *file_name);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Returns the index of the processed base pair (Base1,Base2) of the given
+//  weight, or -1 if this base pair is not processed for this weight yet. The
+//  order of the terms of the bases does not matter.
+		int find_pair(int weight,Polynomial &Base1,Polynomial &Base2);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Marks the base pair (Base1,Base2) as processed for the given weight and
+//  returns its index. Add its representatives with add_pair_rep.
+		int add_pair(int weight,Polynomial &Base1,Polynomial &Base2);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Records that the class of representative rep is found from the base pair
+//  with index pair.
+		void add_pair_rep(int pair,int rep);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Returns the list of representatives found from the base pair with index pair
+		vector<int> &pair_reps(int pair);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Returns the index of the representative of the given weight that is equal
+//  to poly up to a permutation of variables (see == in the Polynomial class),
+//  or -1 if there is none. poly must be sorted.
+		int find_rep(int weight,Polynomial &poly);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Returns the indices of the representatives of the given weight whose affine
+//  fingerprint is fingerprint. Only these can be affine equivalent to a 
+//  polynomial with this fingerprint.
+		vector<int> fingerprint_reps(int weight,ulong fingerprint);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Adds poly as a new representative of the given weight and returns its index.
+		int add_rep(int weight,Polynomial &poly);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Returns the representative with index rep.
+		Polynomial &get_rep(int rep);
+	private:
+		struct base_pair {
+			int weight;
+			vector<uchar> Base1,Base2;
+			vector<int> reps;
+		};
+//  Returns the sorted terms of a base polynomial. This is the key of the bases.
+		vector<uchar> base_key(Polynomial &Base);
+		vector<int> rep_weights;
+		vector<Polynomial> reps;
+		map<pair<int,ulong>,vector<int> > rep_index;
+		vector<base_pair> pairs;
+};
+
+
+
+
+vector<uchar> PolyCache::base_key(Polynomial &Base)
+{
+	vector<uchar> key(Base.poly,Base.poly+Base.num_terms);
+	std::sort(key.begin(),key.end());
+	return key;
+}
+
+
+
+
+void PolyCache::load(const char *file_name)
+{
+	ifstream file;
+	file.open(file_name);
+	if(!file.is_open())
+		return ;
+	string header;
+	file>>header;
+	if(header!="POLY_FINDER_CACHE"){
+		cout<<"ERROR: "<<file_name<<" is not a cache file"<<endl;
+		abort();
+	}
+	int num,n,w;
+	unsigned int t;
+	Polynomial poly;
+	file>>num;
+	for(int i=0;i<num;i++){
+		poly.clear();
+		file>>w>>n;
+		for(int j=0;j<n;j++){
+			file>>t;
+			poly.add_term((uchar)t);
+		}
+		add_rep(w,poly);
+	}
+	file>>num;
+	for(int i=0;i<num;i++){
+		base_pair pair;
+		file>>pair.weight>>n;
+		for(int j=0;j<n;j++){
+			file>>t;
+			pair.Base1.push_back((uchar)t);
+		}
+		file>>n;
+		for(int j=0;j<n;j++){
+			file>>t;
+			pair.Base2.push_back((uchar)t);
+		}
+		file>>n;
+		pair.reps.resize(n);
+		for(int j=0;j<n;j++)
+			file>>pair.reps[j];
+		pairs.push_back(pair);
+	}
+	if(file.fail()){
+		cout<<"ERROR: "<<file_name<<" is corrupted"<<endl;
+		abort();
+	}
+	file.close();
+}
+
+
+
+
+void PolyCache::save(const char *file_name)
+{
+	string tmp_name=string(file_name)+".tmp";
+	ofstream file;
+	file.open(tmp_name.c_str());
+	file<<"POLY_FINDER_CACHE\n";
+	file<<reps.size()<<"\n";
+	for(size_t i=0;i<reps.size();i++){
+		file<<rep_weights[i]<<" "<<reps[i].num_terms;
+		for(int j=0;j<reps[i].num_terms;j++)
+			file<<" "<<(unsigned int)reps[i].poly[j];
+		file<<"\n";
+	}
+	file<<pairs.size()<<"\n";
+	for(size_t i=0;i<pairs.size();i++){
+		file<<pairs[i].weight<<" "<<pairs[i].Base1.size();
+		for(size_t j=0;j<pairs[i].Base1.size();j++)
+			file<<" "<<(unsigned int)pairs[i].Base1[j];
+		file<<" "<<pairs[i].Base2.size();
+		for(size_t j=0;j<pairs[i].Base2.size();j++)
+			file<<" "<<(unsigned int)pairs[i].Base2[j];
+		file<<" "<<pairs[i].reps.size();
+		for(size_t j=0;j<pairs[i].reps.size();j++)
+			file<<" "<<pairs[i].reps[j];
+		file<<"\n";
+	}
+	file.close();
+	if(file.fail() || rename(tmp_name.c_str(),file_name)){
+		cout<<"ERROR: unable to write the cache file "<<file_name<<endl;
+		abort();
+	}
+}
+
+
+
+
+int PolyCache::find_pair(int weight,Polynomial &Base1,Polynomial &Base2)
+{
+	vector<uchar> key1=base_key(Base1),key2=base_key(Base2);
+	for(size_t i=0;i<pairs.size();i++)
+		if(pairs[i].weight==weight && pairs[i].Base1==key1 && pairs[i].Base2==key2)
+			return i;
+	return -1;
+}
+
+
+
+
+int PolyCache::add_pair(int weight,Polynomial &Base1,Polynomial &Base2)
+{
+	base_pair pair;
+	pair.weight=weight;
+	pair.Base1=base_key(Base1);
+	pair.Base2=base_key(Base2);
+	pairs.push_back(pair);
+	return pairs.size()-1;
+}
+
+
+
+
+void PolyCache::add_pair_rep(int pair,int rep)
+{
+	vector<int> &list=pairs[pair].reps;
+	for(size_t i=0;i<list.size();i++)
+		if(list[i]==rep)
+			return ;
+	list.push_back(rep);
+}
+
+
+
+
+vector<int> &PolyCache::pair_reps(int pair)
+{
+	return pairs[pair].reps;
+}
+
+
+
+
+int PolyCache::find_rep(int weight,Polynomial &poly)
+{
+	vector<int> same=fingerprint_reps(weight,affine_fingerprint(poly));
+	for(size_t i=0;i<same.size();i++)
+		if(reps[same[i]]==poly)
+			return same[i];
+	return -1;
+}
+
+
+
+
+vector<int> PolyCache::fingerprint_reps(int weight,ulong fingerprint)
+{
+	auto it=rep_index.find(make_pair(weight,fingerprint));
+	if(it==rep_index.end())
+		return vector<int>();
+	return it->second;
+}
+
+
+
+
+int PolyCache::add_rep(int weight,Polynomial &poly)
+{
+	Polynomial rep;
+	rep=poly;
+	rep_weights.push_back(weight);
+	reps.push_back(rep);
+	rep_index[make_pair(weight,affine_fingerprint(rep))].push_back(reps.size()-1);
+	return reps.size()-1;
+}
+
+
+
+
+Polynomial &PolyCache::get_rep(int rep)
+{
+	return reps[rep];
+}
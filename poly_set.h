@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////////////
+//                           SHARED POLYNOMIAL SET                            //
+//       DEFINES THE 'POLYSET' CLASS, A LOCK-FREE HASH SET OF POLYNOMIALS     //
+//          THAT ALL THE THREADS USE TO REJECT REPEATED POLYNOMIALS.          //
+////////////////////////////////////////////////////////////////////////////////
+
+//The polynomials are stored by their term bitmaps (see term_bitmap in the
+//  Polynomial class), together with the index k of their target weight. The set
+//  is an open addressing hash table with linear probing. A thread claims an empty
+//  slot with a compare-and-swap on its tag (the hash), writes the key, and then 
+//  publishes it with the ready flag. Nothing is ever removed from the set.
+//The set never fills up: it stops taking new polynomials when 3/4 of the slots are used, 
+//  and a lookup gives up after MAX_PROBES slots. Then insert returns true, i.e., the 
+//  repeated polynomial is only removed later, by the == of the list.
+
+class PolySet
+{
+	public:
+
+////////////////////////////////////////////////////////////////////////////////
+//  The constructor makes an empty set that is not in use. insert always
+//  returns true until init is called.
+		PolySet();
+
+////////////////////////////////////////////////////////////////////////////////
+//  Allocates the set for up to capacity polynomials (the table is twice as
+//  large, rounded up to a power of two). It is not thread safe.
+		void init(long capacity);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Inserts poly for the target weight weights[k]. Returns false if a polynomial
+//  with exactly the same terms is already inserted for k, and true otherwise.
+//  It is thread safe and lock-free. If the set is full (see above), or the
+//  polynomial is not found in the first MAX_PROBES slots, it returns true.
+//  poly should be sorted, so that the same polynomial has the same terms.
+		bool insert(int k,Polynomial &poly);
+
+////////////////////////////////////////////////////////////////////////////////
+//  The number of polynomials rejected by insert.
+		atomic<long> num_rejected;
+	private:
+		static const int MAX_PROBES=64;
+		struct slot {
+			atomic<ulong> tag;
+			atomic<int> ready;
+			int k;
+			ulong key[4];
+		};
+		slot *slots;
+		ulong mask;
+		atomic<long> num_entries;
+		long max_entries;
+};
+
+
+
+
+PolySet::PolySet()
+{
+	slots=NULL;
+	mask=0;
+	num_rejected=0;
+	num_entries=0;
+	max_entries=0;
+}
+
+
+
+
+void PolySet::init(long capacity)
+{
+	ulong size=1;
+	while(size<(ulong)(2*capacity))
+		size<<=1;
+	slots=new slot[size];
+	for(ulong i=0;i<size;i++){
+		slots[i].tag=0;
+		slots[i].ready=0;
+	}
+	mask=size-1;
+	max_entries=size/4*3;
+}
+
+
+
+
+bool PolySet::insert(int k,Polynomial &poly)
+{
+	if(slots==NULL)
+		return true;
+	ulong key[4];
+	poly.term_bitmap(key);
+	ulong h=(ulong)k+1;
+	for(int i=0;i<4;i++){
+		h^=key[i]+0x9e3779b97f4a7c15UL+(h<<6)+(h>>2);
+		h*=0xbf58476d1ce4e5b9UL;
+		h^=h>>31;
+	}
+	h|=1;
+	for(ulong i=h&mask,probes=0;probes<MAX_PROBES;i=(i+1)&mask,probes++){
+		ulong tag=slots[i].tag.load(memory_order_acquire);
+		if(tag==0){
+			if(num_entries.load(memory_order_relaxed)>=max_entries)
+				return true;
+			ulong empty=0;
+			if(slots[i].tag.compare_exchange_strong(empty,h,memory_order_acq_rel)){
+				num_entries.fetch_add(1,memory_order_relaxed);
+				slots[i].k=k;
+				for(int j=0;j<4;j++)
+					slots[i].key[j]=key[j];
+				slots[i].ready.store(1,memory_order_release);
+				return true;
+			}
+			tag=empty;
+		}
+		if(tag!=h)
+			continue;
+		//Another thread may still be writing the key of this slot.
+		while(!slots[i].ready.load(memory_order_acquire));
+		if(slots[i].k==k && slots[i].key[0]==key[0] && slots[i].key[1]==key[1] 
+		   && slots[i].key[2]==key[2] && slots[i].key[3]==key[3]){
+			num_rejected.fetch_add(1,memory_order_relaxed);
+			return false;
+		}
+	}
+	return true;
+}
@@ -34,8 +34,7 @@ class Polynomial
 		void print_bin();
 
 ////////////////////////////////////////////////////////////////////////////////
-//  Sets the num_term=0, and removes all auxiliary buffers.
-//  See below for instruction
+//  Sets the num_term=0.
 		void clear();
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -46,7 +45,7 @@ class Polynomial
 		ulong truth_table();
 
 ////////////////////////////////////////////////////////////////////////////////
-//	Equal operator for the polynomials. Does not copy the buffers though.
+//	Equal operator for the polynomials.
 		void operator=(Polynomial p);
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -55,11 +54,13 @@ class Polynomial
     bool operator==(Polynomial p);
 
 ////////////////////////////////////////////////////////////////////////////////
-//  Sets buffers. The polynomial class needs three more instances of itself to
-//  to operate the simplification process. It is not memory and time efficient 
-//  to generate these buffers each time, so I feed the same buffer to different
-//  polynomials. This function is used to assign these buffers.  
-		void set_buffers(Polynomial buffers[3]);
+//  Fills inv with NUM_INVARIANTS numbers that do not change under permutations
+//  of variables: the number of terms, the sorted profile (the number of terms
+//  containing each variable), the number of terms of each degree 0,...,8, and
+//  the sorted list of the number of terms containing each pair of variables.
+//  Polynomials with different invariants can never be ==.
+		static const int NUM_INVARIANTS=46;
+		void invariants(int *inv);
 
 ////////////////////////////////////////////////////////////////////////////////
 //  This function permutes the variables such that x1 appears the most in the 
@@ -81,24 +82,61 @@ class Polynomial
 //  weight does not decrease for "wait" many consecutive steps, the function 
 //  returns the polynomial with the minimum number of terms derived in any of 
 //  the steps. 
+//  The search described above is the default strategy (greedy_search). Other 
+//  strategies with the same wait and random_jumps controls can be selected 
+//  with the strategy pointer below (see local_search.h).
 		void quick_simplify(int wait,int random_jumps);
-	private:
-//  The following contains the number of repetition of each variable.		
-		int profile[8];
-//  The following is quick_simplify minus sort
-		void simplify(int wait,int random_steps);
+
+////////////////////////////////////////////////////////////////////////////////
+//  The local search strategy used by quick_simplify. It takes the polynomial,
+//  wait and random_jumps, and leaves the polynomial with the fewest terms it
+//  finds in it. The strategies are defined in local_search.h.
+		static void (*strategy)(Polynomial &p,int wait,int random_jumps);
+
+////////////////////////////////////////////////////////////////////////////////
+//  The moves of the local search. The move (var,var) is the plus_one of var,
+//  i.e., x_var -> x_var+1, and the move (source,target) with source!=target is
+//  the transposition x_source -> x_source+x_target. Each move is its own 
+//  inverse. move_num_terms returns the number of terms after the move without
+//  changing the polynomial, and make_move performs the move. The number of 
+//  terms is counted from the collisions of the terms generated by the move 
+//  with the existing terms (see move_bitmap), so nothing is built until a move
+//  is made. As everywhere in this code, a constant term generated by a move is
+//  ignored.
+		int move_num_terms(int source,int target);
+		void make_move(int source,int target);
+
+////////////////////////////////////////////////////////////////////////////////
 //  Performs all possible transpositions and accepts them if the number of 
 //  terms decreases.
 		bool transpositions();
+
+////////////////////////////////////////////////////////////////////////////////
 //  Performs all possible plus_ones and accepts them if the number of 
 //  terms decreases.
 		bool plus_ones();
-//  Makes the transposition and reports the extra terms into buffer 		
-		void transposition(int var_source,int var_target);
-//  Makes the plus_one and reports the extra terms into buffer 		
-		void plus_one(int var);
-//  Mixes the self and buffer into replica 
-		void mix_buffer_to_replica();
+
+////////////////////////////////////////////////////////////////////////////////
+//  Sets the bit number t of bits for every term t of the polynomial. Two 
+//  polynomials have the same terms exactly if their bitmaps are the same.
+		void term_bitmap(ulong bits[4]);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Replaces the terms of the polynomial with the terms whose bits are set in
+//  bits (the inverse of term_bitmap). The terms are not sorted.
+		void set_terms(ulong bits[4]);
+	private:
+//  The following contains the number of repetition of each variable.		
+		int profile[8];
+//  The following is quick_simplify minus sort. It does nothing (and sets 
+//  out_of_time) when the time limit has passed (see time_is_up in classes.cpp).
+		void simplify(int wait,int random_steps);
+//  Sets the bit number g of toggle for every term g that is generated an odd
+//  number of times by the move (source,target). These are the terms that the 
+//  move adds to (or removes from, if they already exist) the polynomial.
+		void move_bitmap(int source,int target,ulong toggle[4]);
+//  Returns the change of the number of terms for the toggle of move_bitmap
+		int move_delta(ulong bits[4],ulong toggle[4]);
 //  Swap bits number var1 and var2 of num and returns the results
 		uchar swap_bit(uchar num,int var1,int var2);
 //  Permutes the bits of num according to perm
@@ -113,8 +151,6 @@ class Polynomial
 		void sort_variables();
 //  Sort the terms in poly
 		void sort_terms();
-//  Pointers to the three buffers
-		Polynomial *replica,*buffer,*second_replica;
 };
 
 
@@ -159,11 +195,38 @@ bool Polynomial::operator==(Polynomial p)
 
 
 
-void Polynomial::set_buffers(Polynomial buffers[3])
+void Polynomial::invariants(int *inv)
 {
-  replica=&buffers[0];//replica1;
-  buffer=&buffers[1];//buffer1;
-  second_replica=&buffers[2];//second_replica1;
+	int degree[9],pairs[28];
+	int i,j,k,c;
+	for(i=0;i<9;i++)
+		degree[i]=0;
+	for(i=0;i<28;i++)
+		pairs[i]=0;
+	for(i=0;i<num_terms;i++){
+		c=0;
+		k=0;
+		for(j=0;j<8;j++){
+			if(poly[i]&((uchar)1<<j)){
+				c++;
+				for(int l=j+1;l<8;l++)
+					if(poly[i]&((uchar)1<<l))
+						pairs[k+l-j-1]++;
+			}
+			k+=7-j;
+		}
+		degree[c]++;
+	}
+	profile_maker();
+	inv[0]=num_terms;
+	for(i=0;i<8;i++)
+		inv[1+i]=profile[i];
+	std::sort(inv+1,inv+9);
+	for(i=0;i<9;i++)
+		inv[9+i]=degree[i];
+	std::sort(pairs,pairs+28);
+	for(i=0;i<28;i++)
+		inv[18+i]=pairs[i];
 }
 
 
@@ -172,9 +235,6 @@ void Polynomial::set_buffers(Polynomial buffers[3])
 void Polynomial::clear()
 {
 	num_terms=0;
-	replica=NULL;
-	buffer=NULL;
-	second_replica=NULL;
 }
 
 
@@ -320,10 +380,6 @@ void Polynomial::sort()
 
 void Polynomial::quick_simplify(int wait,int random_jumps)
 {
-	if(replica==NULL){
-		cout<<"ERROR: buffer in quick simplify is not set";
-		abort();
-	}
 	simplify(wait,random_jumps);
 	sort();
 }
@@ -333,29 +389,91 @@ void Polynomial::quick_simplify(int wait,int random_jumps)
 
 void Polynomial::simplify(int wait,int random_steps)
 {
-	int min_terms=255;
-	int steps=0;
-	int a,b;
-	*second_replica=*this;
-	while(steps<wait){
-		steps++;
-		for(int i=0;i<random_steps;i++){
-			a=rand()%8;
-			b=rand()%8;
-			if(a!=b){
-				transposition(a,b);
-				*this=(*replica);
-			}
+	if(time_is_up()){
+		out_of_time=true;
+		return ;
+	}
+	strategy(*this,wait,random_steps);
+	return ;
+}
+
+
+
+
+int Polynomial::move_num_terms(int source,int target)
+{
+	ulong bits[4],toggle[4];
+	term_bitmap(bits);
+	move_bitmap(source,target,toggle);
+	return num_terms+move_delta(bits,toggle);
+}
+
+
+
+
+void Polynomial::make_move(int source,int target)
+{
+	ulong bits[4],toggle[4];
+	term_bitmap(bits);
+	move_bitmap(source,target,toggle);
+	for(int i=0;i<4;i++)
+		bits[i]^=toggle[i];
+	set_terms(bits);
+	return ;
+}
+
+
+
+
+void Polynomial::term_bitmap(ulong bits[4])
+{
+	bits[0]=bits[1]=bits[2]=bits[3]=0;
+	for(int i=0;i<num_terms;i++)
+		bits[poly[i]>>6]|=((ulong)1)<<(poly[i]&63);
+}
+
+
+
+
+void Polynomial::move_bitmap(int source,int target,ulong toggle[4])
+{
+	uchar s=(uchar)1<<source,t=(uchar)1<<target,g;
+	toggle[0]=toggle[1]=toggle[2]=toggle[3]=0;
+	for(int i=0;i<num_terms;i++)
+		if(poly[i]&s){
+			g=(poly[i]^s)|t;
+			if(source==target)
+				g=poly[i]^s;
+			toggle[g>>6]^=((ulong)1)<<(g&63);
 		}
-		while(plus_ones()||transpositions());
-		if(num_terms<min_terms){
-			min_terms=num_terms;
-			steps=0;
-			*second_replica=*this;
+	toggle[0]&=~((ulong)1);
+}
+
+
+
+
+void Polynomial::set_terms(ulong bits[4])
+{
+	num_terms=0;
+	for(int i=0;i<4;i++){
+		ulong b=bits[i];
+		while(b){
+			poly[num_terms]=(uchar)((i<<6)+__builtin_ctzl(b));
+			num_terms++;
+			b&=b-1;
 		}
 	}
-	*this=*second_replica;
-	return ;
+}
+
+
+
+
+int Polynomial::move_delta(ulong bits[4],ulong toggle[4])
+{
+	int delta=0;
+	for(int i=0;i<4;i++)
+		delta+=__builtin_popcountl(toggle[i]&~bits[i])-__builtin_popcountl(toggle[i]&bits[i]);
+	return delta;
 }
 
 
@@ -420,83 +538,17 @@ void Polynomial::print()
 
 
 
-void Polynomial::mix_buffer_to_replica()
-{
-	bool flag;
-	(*replica).num_terms=0;
-	for(int i=0;i<num_terms;i++){
-		flag=true;
-		for(int j=0;j<(*buffer).num_terms;j++)
-			if((*buffer).poly[j]==poly[i]){
-				(*buffer).poly[j]=0;
-				flag=!flag;
-			}
-		if(flag){
-			(*replica).poly[(*replica).num_terms]=poly[i];
-			(*replica).num_terms++;
-		}
-	}
-	for(int i=0;i<(*buffer).num_terms;i++){
-		
-		if((*buffer).poly[i]){
-			flag=true;
-			for(int j=i+1;j<(*buffer).num_terms;j++)
-				if((*buffer).poly[j]==(*buffer).poly[i]){
-					(*buffer).poly[j]=0;
-					flag=!flag;
-				}
-			if(flag){
-				(*replica).poly[(*replica).num_terms]=(*buffer).poly[i];
-        (*replica).num_terms++;
-			}
-			(*buffer).poly[i]=0;
-		}
-	}
-	return ;
-}
-
-
-
-
-void Polynomial::plus_one(int var)
-{
-	(*buffer).num_terms=0;
-	for(int i=0;i<num_terms;i++)
-		if(poly[i]&((uchar)1<<var)){
-			(*buffer).poly[(*buffer).num_terms]=poly[i]^((uchar)1<<var);
-			(*buffer).num_terms++;
-		}
-	mix_buffer_to_replica();
-	return ;	
-}
-
-
-
-
-
-void Polynomial::transposition(int var_source, int var_target)
-{
-	(*buffer).num_terms=0;
-	for(int i=0;i<num_terms;i++)
-		if(poly[i]& ((uchar)1<<var_source)){
-			(*buffer).poly[(*buffer).num_terms]=poly[i]^((uchar)1<<var_source)|((uchar)1<<var_target);
-			(*buffer).num_terms++;
-		}
-	mix_buffer_to_replica();
-	return ;	
-}
-
-
-
-
-
 bool Polynomial::plus_ones()
 {
   bool flag=false;
+  ulong bits[4],toggle[4];
+  term_bitmap(bits);
   for(int var=0;var<8;var++){
-    plus_one(var);
-    if((*replica).num_terms<num_terms){
-			*this=(*replica);
+    move_bitmap(var,var,toggle);
+    if(move_delta(bits,toggle)<0){
+      for(int i=0;i<4;i++)
+        bits[i]^=toggle[i];
+      set_terms(bits);
       flag=true;
     }
   }
@@ -509,13 +561,17 @@ bool Polynomial::plus_ones()
 
 bool Polynomial::transpositions()
 {
-  bool flag=false;;
+  bool flag=false;
+  ulong bits[4],toggle[4];
+  term_bitmap(bits);
   for(int var_source=0;var_source<8;var_source++)
     for(int var_target=0;var_target<8;var_target++)
       if(var_target!=var_source){
-        transposition(var_source,var_target);
-        if( (*replica).num_terms < num_terms){
-					*this=(*replica);
+        move_bitmap(var_source,var_target,toggle);
+        if(move_delta(bits,toggle)<0){
+          for(int i=0;i<4;i++)
+            bits[i]^=toggle[i];
+          set_terms(bits);
           flag=true;
         }
       }
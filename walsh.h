@@ -0,0 +1,90 @@
+////////////////////////////////////////////////////////////////////////////////
+//                       WALSH-HADAMARD SPECTRUM LIBRARY                      //
+//       COMPUTES THE WALSH SPECTRUM OF A POLYNOMIAL OF 8 VARIABLES, AND      //
+//        AN AFFINE INVARIANT FINGERPRINT OF THE POLYNOMIAL FROM IT.          //
+////////////////////////////////////////////////////////////////////////////////
+
+//The full truth table of a polynomial of 8 variables has 256 values. It is stored as
+//  256 bits in 4 ulong numbers, with the same layout as term_bitmap in the Polynomial
+//  class: bit x of the table is the value of the polynomial at the point whose
+//  coordinates are the binary digits of x (x1 is the lowest bit).
+//The Walsh spectrum of f is W(u) = sum over x of (-1)^(f(x)+u.x). Under an affine change
+//  of variables x -> Ax+b (which includes all transpositions and plus_ones), the values
+//  of W are only permuted and change sign. Adding the constant term changes the sign of
+//  all values. So the multiset of |W(u)| is an invariant of the affine classes of this
+//  code. The same holds for the multiset of the weights of the derivatives
+//  f(x)+f(x+a), a!=0, which are read from the autocorrelation, i.e., the inverse Walsh
+//  transform of W^2.
+//The loops below have fixed sizes and contiguous inner loops, so that the compiler
+//  vectorizes them (with -O3).
+
+////////////////////////////////////////////////////////////////////////////////
+//  Turns the bitmap of the terms of a polynomial (term_bitmap) into its truth
+//  table, in place (the binary Moebius transform).
+void anf_to_truth_table(ulong t[4])
+{
+	const ulong mask[6]={0x5555555555555555UL,0x3333333333333333UL,0x0f0f0f0f0f0f0f0fUL,
+	                     0x00ff00ff00ff00ffUL,0x0000ffff0000ffffUL,0x00000000ffffffffUL};
+	for(int i=0;i<6;i++)
+		for(int j=0;j<4;j++)
+			t[j]^=(t[j]&mask[i])<<(1<<i);
+	t[1]^=t[0];
+	t[3]^=t[2];
+	t[2]^=t[0];
+	t[3]^=t[1];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//  The fast Walsh-Hadamard transform of 256 numbers, in place.
+void fwht(int v[256])
+{
+	for(int h=1;h<256;h<<=1)
+		for(int i=0;i<256;i+=2*h)
+			for(int j=i;j<i+h;j++){
+				int a=v[j],b=v[j+h];
+				v[j]=a+b;
+				v[j+h]=a-b;
+			}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//  Fills W with the Walsh spectrum of the polynomial p.
+void walsh_spectrum(Polynomial &p,int W[256])
+{
+	ulong t[4];
+	p.term_bitmap(t);
+	anf_to_truth_table(t);
+	for(int x=0;x<256;x++)
+		W[x]=1-2*(int)((t[x>>6]>>(x&63))&1);
+	fwht(W);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//  Returns a hash of the multiset of |W(u)| and of the multiset of the weights
+//  of the derivatives of p. Affine equivalent polynomials have the same
+//  fingerprint, so polynomials with different fingerprints are never affine
+//  equivalent. (The converse is not true.)
+ulong affine_fingerprint(Polynomial &p)
+{
+	int W[256],abs_count[257],derivative_count[257];
+	walsh_spectrum(p,W);
+	for(int i=0;i<257;i++)
+		abs_count[i]=derivative_count[i]=0;
+	for(int u=0;u<256;u++){
+		abs_count[abs(W[u])]++;
+		W[u]*=W[u];
+	}
+	//Now W is the transform of the autocorrelation r times 256, and the weight of the
+	//  derivative in the direction a is (256-r(a))/2.
+	fwht(W);
+	for(int a=1;a<256;a++)
+		derivative_count[(256-W[a]/256)/2]++;
+	ulong h=0xcbf29ce484222325UL;
+	for(int i=0;i<257;i++){
+		h^=(ulong)abs_count[i];
+		h*=0x100000001b3UL;
+		h^=(ulong)derivative_count[i]<<32;
+		h*=0x100000001b3UL;
+	}
+	return h;
+}